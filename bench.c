@@ -0,0 +1,706 @@
+/* Luke Tchang
+ * CS 107
+ * bench: This program measures a heap allocator through the allocator.h interface, so the same source builds
+ *        against implicit_allocator.c or explicit_allocator.c (see README.md). A workload is either a trace
+ *        file or one of the synthetic generators and is always turned into a list of operations first, then
+ *        replayed twice on a fresh heap: once untimed per operation to get throughput, once timing every call
+ *        to get latency percentiles along with utilization and fragmentation. Every block gets a tag byte at
+ *        both ends so a replay also catches allocators that hand out overlapping or corrupted blocks.
+ *
+ *        Text traces hold one operation per line ("a id size", "r id size", "f id"), with '#' starting a
+ *        comment. Binary traces start with TRACE_MAGIC, a 32-bit version and a 64-bit operation count,
+ *        followed by one trace_record per operation.
+ *
+ *        Built with -DBENCH_EXPLICIT against explicit_allocator.c, -p picks the fit policies to compare and each
+ *        workload is run once under each of them through myinit_config.
+ */
+#include "allocator.h"
+#ifdef BENCH_EXPLICIT
+#include "explicit_allocator.h"
+#endif
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+​
+​
+//CONSTANTS:
+//__________
+#define TRACE_MAGIC "HTRC"
+#define TRACE_VERSION 1
+#define DEFAULT_HEAP_SIZE (1UL << 30)
+#define DEFAULT_OPS 1000000
+#define QUEUE_DEPTH 1000
+#define LIVE_SLOTS 4096
+#define MAX_POWER_SIZE (1 << 20)
+#define REALLOC_SLOTS 1024
+#define MAX_POLICIES 3
+​
+/* GLOBAL VARIABLES:
+ * _________________
+ * rng_state: state of the xorshift generator behind every synthetic workload (seeded with -r)
+ * config: with BENCH_EXPLICIT, the configuration replay hands to myinit_config (its fit_policy is set per run)
+ */
+static uint64_t rng_state = 1;
+#ifdef BENCH_EXPLICIT
+static allocator_config config;
+#endif
+​
+​
+//STRUCT INFO
+//___________
+​
+/* Struct: op
+ * __________
+ * Description: The "op" struct is one allocator call: type is 'a' (mymalloc), 'r' (myrealloc) or 'f' (myfree),
+ *              id names the block the call works on and size is the requested size ('a' and 'r' only).
+ */
+typedef struct {
+    char type;
+    uint32_t id;
+    size_t size;
+} op;
+​
+/* Struct: trace
+ * _____________
+ * Description: The "trace" struct is a growable list of operations plus the number of distinct block ids used.
+ */
+typedef struct {
+    op *ops;
+    size_t count;
+    size_t capacity;
+    uint32_t nids;
+} trace;
+​
+/* Struct: trace_record
+ * ____________________
+ * Description: The "trace_record" struct is the on-disk form of one operation in a binary trace (host byte order).
+ */
+typedef struct {
+    uint8_t type;
+    uint8_t pad[3];
+    uint32_t id;
+    uint64_t size;
+} trace_record;
+​
+/* Struct: result
+ * ______________
+ * Description: The "result" struct collects the numbers reported for one workload.
+ *    - ops_per_sec: throughput of the untimed replay
+ *    - p50 / p99 / p999: per-call latency percentiles in nanoseconds
+ *    - peak_util: peak live payload over the highest heap offset ever handed out
+ *    - frag: average share of the touched heap (up to the high-water mark) not holding live payload
+ */
+typedef struct {
+    double ops_per_sec;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    double peak_util;
+    double frag;
+} result;
+​
+​
+//TRACE HELPERS:
+//______________
+​
+/* Function: rng_next
+ * ___________________
+ * Return: next value of the xorshift64 generator
+ */
+uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+​
+/* Function: add_op
+ * ___________________
+ * Parameters:
+ *    - tr: trace to append to
+ *    - type: 'a', 'r' or 'f'
+ *    - id: block the operation works on
+ *    - size: requested size (ignored for 'f')
+ *
+ * Return: N/A
+ */
+void add_op(trace *tr, char type, uint32_t id, size_t size) {
+    if(tr->count == tr->capacity) {
+        tr->capacity = (tr->capacity != 0) ? tr->capacity * 2 : 1024;
+        tr->ops = realloc(tr->ops, tr->capacity * sizeof(op));
+        if(tr->ops == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    tr->ops[tr->count++] = (op){type, id, size};
+    if(id >= tr->nids) {
+        tr->nids = id + 1;
+    }
+}
+​
+/* Function: read_text_trace
+ * ___________________
+ * Parameters:
+ *    - fp: open trace file, positioned at the start
+ *    - tr: empty trace to fill
+ *
+ * Return: true if every line parsed, false otherwise (after printing the offending line number)
+ */
+bool read_text_trace(FILE *fp, trace *tr) {
+    char line[256];
+    size_t lineno = 0;
+    while(fgets(line, sizeof(line), fp) != NULL) {
+        lineno += 1;
+        char type;
+        unsigned long id;
+        unsigned long long size = 0;
+        char *start = line + strspn(line, " \t");
+        if(*start == '#' || *start == '\n' || *start == '\0') {
+            continue;
+        }
+        int fields = sscanf(start, "%c %lu %llu", &type, &id, &size);
+        if(fields < 2 || (type != 'f' && (type != 'a' && type != 'r')) || (type != 'f' && fields != 3)) {
+            fprintf(stderr, "bad trace line %zu\n", lineno);
+            return false;
+        }
+        add_op(tr, type, (uint32_t)id, size);
+    }
+    return true;
+}
+​
+/* Function: read_binary_trace
+ * ___________________
+ * Parameters:
+ *    - fp: open trace file, positioned right after TRACE_MAGIC
+ *    - tr: empty trace to fill
+ *
+ * Return: true if the version matches and every record could be read, false otherwise
+ */
+bool read_binary_trace(FILE *fp, trace *tr) {
+    uint32_t version;
+    uint64_t count;
+    if(fread(&version, sizeof(version), 1, fp) != 1 || version != TRACE_VERSION || fread(&count, sizeof(count), 1, fp) != 1) {
+        fprintf(stderr, "bad binary trace header\n");
+        return false;
+    }
+    for(uint64_t i = 0; i < count; i++) {
+        trace_record rec;
+        if(fread(&rec, sizeof(rec), 1, fp) != 1) {
+            fprintf(stderr, "binary trace ends after %llu of %llu records\n", (unsigned long long)i, (unsigned long long)count);
+            return false;
+        }
+        add_op(tr, (char)rec.type, rec.id, rec.size);
+    }
+    return true;
+}
+​
+/* Function: load_trace
+ * ___________________
+ * Parameters:
+ *    - path: trace file (text or binary, told apart by TRACE_MAGIC)
+ *    - tr: empty trace to fill
+ *
+ * Return: true if the file could be read, false otherwise
+ */
+bool load_trace(const char *path, trace *tr) {
+    FILE *fp = fopen(path, "rb");
+    if(fp == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char magic[4];
+    bool binary = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+    if(!binary) {
+        rewind(fp);
+    }
+    bool ok = binary ? read_binary_trace(fp, tr) : read_text_trace(fp, tr);
+    fclose(fp);
+    return ok;
+}
+​
+/* Function: write_binary_trace
+ * ___________________
+ * Parameters:
+ *    - path: file to create
+ *    - tr: trace to write
+ *
+ * Return: true if the whole trace was written, false otherwise
+ */
+bool write_binary_trace(const char *path, const trace *tr) {
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    uint32_t version = TRACE_VERSION;
+    uint64_t count = tr->count;
+    bool ok = fwrite(TRACE_MAGIC, 4, 1, fp) == 1 && fwrite(&version, sizeof(version), 1, fp) == 1 && fwrite(&count, sizeof(count), 1, fp) == 1;
+    for(size_t i = 0; ok && i < tr->count; i++) {
+        trace_record rec = {(uint8_t)tr->ops[i].type, {0}, tr->ops[i].id, tr->ops[i].size};
+        ok = fwrite(&rec, sizeof(rec), 1, fp) == 1;
+    }
+    return (fclose(fp) == 0) && ok;
+}
+​
+​
+//SYNTHETIC WORKLOADS:
+//____________________
+​
+/* Function: gen_producer
+ * ___________________
+ * Parameters:
+ *    - tr: empty trace to fill
+ *    - nops: approximate number of operations
+ *
+ * Return: N/A
+ *
+ * Description: Producer/consumer: messages of 16 to 512 bytes are allocated in order and freed in the same order
+ *              once QUEUE_DEPTH of them are in flight, so frees always hit the oldest blocks.
+ */
+void gen_producer(trace *tr, size_t nops) {
+    uint32_t head = 0;
+    for(uint32_t id = 0; tr->count < nops; id++) {
+        add_op(tr, 'a', id, 16 + rng_next() % 497);
+        if(id - head >= QUEUE_DEPTH) {
+            add_op(tr, 'f', head++, 0);
+        }
+    }
+    while(head < tr->nids) {
+        add_op(tr, 'f', head++, 0);
+    }
+}
+​
+/* Function: power_size
+ * ___________________
+ * Return: a size drawn from a Pareto distribution (alpha 1.5, minimum 8 bytes) capped at MAX_POWER_SIZE
+ */
+size_t power_size(void) {
+    double u = (double)(rng_next() >> 11) / (double)(1ULL << 53);
+    double size = 8.0 * pow(1.0 - u, -1.0 / 1.5);
+    return (size < MAX_POWER_SIZE) ? (size_t)size : MAX_POWER_SIZE;
+}
+​
+/* Function: gen_powerlaw
+ * ___________________
+ * Parameters:
+ *    - tr: empty trace to fill
+ *    - nops: approximate number of operations
+ *
+ * Return: N/A
+ *
+ * Description: Power-law sizes: each step picks one of LIVE_SLOTS slots at random and either fills it with a new
+ *              block of power_size bytes or frees the block it holds, so blocks die in random order.
+ */
+void gen_powerlaw(trace *tr, size_t nops) {
+    bool live[LIVE_SLOTS] = {false};
+    uint32_t ids[LIVE_SLOTS];
+    uint32_t next_id = 0;
+    while(tr->count < nops) {
+        size_t slot = rng_next() % LIVE_SLOTS;
+        if(live[slot]) {
+            add_op(tr, 'f', ids[slot], 0);
+        } else {
+            ids[slot] = next_id++;
+            add_op(tr, 'a', ids[slot], power_size());
+        }
+        live[slot] = !live[slot];
+    }
+    for(size_t slot = 0; slot < LIVE_SLOTS; slot++) {
+        if(live[slot]) {
+            add_op(tr, 'f', ids[slot], 0);
+        }
+    }
+}
+​
+/* Function: gen_realloc
+ * ___________________
+ * Parameters:
+ *    - tr: empty trace to fill
+ *    - nops: approximate number of operations
+ *
+ * Return: N/A
+ *
+ * Description: Realloc-heavy: blocks start at 8 to 135 bytes and most steps resize a live block to between half
+ *              and twice its size (mostly growing), which is how buffers and vectors behave.
+ */
+void gen_realloc(trace *tr, size_t nops) {
+    size_t sizes[REALLOC_SLOTS] = {0};
+    while(tr->count < nops) {
+        uint32_t slot = rng_next() % REALLOC_SLOTS;
+        int roll = rng_next() % 10;
+        if(sizes[slot] == 0) {
+            sizes[slot] = 8 + rng_next() % 128;
+            add_op(tr, 'a', slot, sizes[slot]);
+        } else if(roll < 8) {
+            size_t grown = sizes[slot] / 2 + rng_next() % (sizes[slot] * 3 / 2 + 1);
+            sizes[slot] = (grown == 0) ? 1 : (grown < MAX_POWER_SIZE) ? grown : MAX_POWER_SIZE;
+            add_op(tr, 'r', slot, sizes[slot]);
+        } else {
+            sizes[slot] = 0;
+            add_op(tr, 'f', slot, 0);
+        }
+    }
+    for(uint32_t slot = 0; slot < REALLOC_SLOTS; slot++) {
+        if(sizes[slot] != 0) {
+            add_op(tr, 'f', slot, 0);
+        }
+    }
+}
+​
+​
+//REPLAY:
+//_______
+​
+/* Function: now_ns
+ * ___________________
+ * Return: current CLOCK_MONOTONIC time in nanoseconds
+ */
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+​
+/* Function: init_heap
+ * ___________________
+ * Parameters:
+ *    - heap / heap_size: segment to hand to the allocator
+ *
+ * Return: true if the allocator accepted the segment
+ */
+bool init_heap(void *heap, size_t heap_size) {
+#ifdef BENCH_EXPLICIT
+    return myinit_config(heap, heap_size, &config);
+#else
+    return myinit(heap, heap_size);
+#endif
+}
+​
+/* Function: compare_u64
+ * ___________________
+ * Description: qsort comparator for uint64_t values.
+ */
+int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+​
+/* Function: tag_block
+ * ___________________
+ * Parameters:
+ *    - ptr: block returned by the allocator
+ *    - size: requested size
+ *    - id: block id, whose low byte is the tag
+ *
+ * Return: N/A
+ */
+void tag_block(void *ptr, size_t size, uint32_t id) {
+    ((unsigned char *)ptr)[0] = (unsigned char)id;
+    ((unsigned char *)ptr)[size - 1] = (unsigned char)id;
+}
+​
+/* Function: check_tag
+ * ___________________
+ * Parameters:
+ *    - ptr: block about to be freed or resized
+ *    - size: size it was tagged with
+ *    - id: block id
+ *
+ * Return: true if both tag bytes are intact, false otherwise
+ */
+bool check_tag(void *ptr, size_t size, uint32_t id) {
+    return ((unsigned char *)ptr)[0] == (unsigned char)id && ((unsigned char *)ptr)[size - 1] == (unsigned char)id;
+}
+​
+/* Function: replay
+ * ___________________
+ * Parameters:
+ *    - tr: operations to run
+ *    - heap / heap_size: segment handed to the allocator (reinitialized first, see init_heap)
+ *    - latencies: per-operation latencies to fill in, NULL for the untimed pass
+ *    - validate: call validate_heap after every operation
+ *    - res: utilization and fragmentation are written here (timed pass only)
+ *
+ * Return: true if every operation succeeded and no block was corrupted, false otherwise
+ *
+ * Description: Only blocks inside the segment count toward the high-water mark, so memory an allocator maps on
+ *              its own is treated like payload that costs no heap. Zero-size requests (malloc(0) and realloc(p, 0)
+ *              in captured traces) may return NULL: an allocation of 0 bytes stays live with nothing to tag, and a
+ *              realloc to 0 that returns NULL counts as a free.
+ */
+bool replay(const trace *tr, void *heap, size_t heap_size, uint64_t *latencies, bool validate, result *res) {
+    void **ptrs = calloc(tr->nids, sizeof(void *));
+    size_t *sizes = calloc(tr->nids, sizeof(size_t));
+    bool *held = calloc(tr->nids, sizeof(bool));
+    if(ptrs == NULL || sizes == NULL || held == NULL || !init_heap(heap, heap_size)) {
+        fprintf(stderr, "could not set up the heap\n");
+        free(ptrs);
+        free(sizes);
+        free(held);
+        return false;
+    }
+
+    bool ok = true;
+    size_t live = 0;
+    size_t peak_live = 0;
+    size_t high_water = 0;
+    double frag_sum = 0;
+    for(size_t i = 0; i < tr->count && ok; i++) {
+        const op *curr = &tr->ops[i];
+        void *old = ptrs[curr->id];
+        size_t old_size = sizes[curr->id];
+        if(curr->type != 'a' && (!held[curr->id] || (old_size != 0 && !check_tag(old, old_size, curr->id)))) {
+            fprintf(stderr, "op %zu: block %u is %s\n", i, curr->id, (!held[curr->id]) ? "not live" : "corrupted");
+            ok = false;
+            break;
+        }
+
+        uint64_t start = (latencies != NULL) ? now_ns() : 0;
+        void *ptr = NULL;
+        if(curr->type == 'a') {
+            ptr = mymalloc(curr->size);
+        } else if(curr->type == 'r') {
+            ptr = myrealloc(old, curr->size);
+        } else {
+            myfree(old);
+        }
+        if(latencies != NULL) {
+            latencies[i] = now_ns() - start;
+        }
+
+        live -= old_size;
+        ptrs[curr->id] = ptr;
+        sizes[curr->id] = 0;
+        held[curr->id] = curr->type == 'a' || (curr->type == 'r' && ptr != NULL);
+        if(curr->type != 'f' && curr->size != 0) {
+            if(ptr == NULL) {
+                fprintf(stderr, "op %zu: out of memory (%zu bytes)\n", i, curr->size);
+                ok = false;
+                break;
+            }
+            if(curr->type == 'r' && old_size != 0 && ((unsigned char *)ptr)[0] != (unsigned char)curr->id) {
+                fprintf(stderr, "op %zu: realloc lost the contents of block %u\n", i, curr->id);
+                ok = false;
+            }
+            tag_block(ptr, curr->size, curr->id);
+            sizes[curr->id] = curr->size;
+            live += curr->size;
+            size_t offset = (size_t)((char *)ptr - (char *)heap) + curr->size;
+            if(offset <= heap_size && offset > high_water) {
+                high_water = offset;
+            }
+        }
+        peak_live = (live > peak_live) ? live : peak_live;
+        frag_sum += (high_water != 0 && live < high_water) ? 1.0 - (double)live / high_water : 0;
+        if(validate && !validate_heap()) {
+            fprintf(stderr, "op %zu: validate_heap failed\n", i);
+            ok = false;
+        }
+    }
+
+    if(res != NULL) {
+        res->peak_util = (high_water != 0) ? (double)peak_live / high_water : 0;
+        res->frag = (tr->count != 0) ? frag_sum / tr->count : 0;
+    }
+    free(ptrs);
+    free(sizes);
+    free(held);
+    return ok;
+}
+​
+/* Function: run_workload
+ * ___________________
+ * Parameters:
+ *    - name: workload name printed in the report
+ *    - tr: operations to run
+ *    - heap / heap_size: segment handed to the allocator
+ *    - validate: call validate_heap after every operation of the timed pass
+ *
+ * Return: true if both passes succeeded, false otherwise
+ */
+bool run_workload(const char *name, const trace *tr, void *heap, size_t heap_size, bool validate) {
+    result res = {0};
+    uint64_t *latencies = malloc((tr->count + 1) * sizeof(uint64_t));
+    if(latencies == NULL) {
+        perror("malloc");
+        return false;
+    }
+
+    uint64_t start = now_ns();
+    bool ok = replay(tr, heap, heap_size, NULL, false, NULL);
+    uint64_t elapsed = now_ns() - start;
+    ok = ok && replay(tr, heap, heap_size, latencies, validate, &res);
+    if(ok && tr->count != 0) {
+        qsort(latencies, tr->count, sizeof(uint64_t), compare_u64);
+        res.ops_per_sec = (elapsed != 0) ? tr->count * 1e9 / elapsed : 0;
+        res.p50 = latencies[tr->count / 2];
+        res.p99 = latencies[tr->count * 99 / 100];
+        res.p999 = latencies[tr->count * 999 / 1000];
+        printf("%-16s %10zu %14.0f %8llu %8llu %8llu %9.1f%% %9.1f%%\n", name, tr->count, res.ops_per_sec,
+               (unsigned long long)res.p50, (unsigned long long)res.p99, (unsigned long long)res.p999,
+               res.peak_util * 100, res.frag * 100);
+    }
+    free(latencies);
+    return ok;
+}
+​
+​
+//MAIN:
+//_____
+​
+/* Function: usage
+ * ___________________
+ * Description: Prints the command line options to stderr.
+ */
+void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-s heap_bytes] [-n ops] [-r seed] [-v] [-o out.bin] [-p policies] workload...\n"
+                    "  workload: a trace file (text or binary), or producer, powerlaw or realloc\n"
+                    "  -o: write the (single) workload as a binary trace instead of running it\n"
+                    "  -p: comma-separated fit policies to run each workload under (first, best, addr;\n"
+                    "      only when built with -DBENCH_EXPLICIT)\n", prog);
+}
+​
+/* Function: parse_policies
+ * ___________________
+ * Parameters:
+ *    - list: comma-separated policy names from -p
+ *    - policies: filled in with the fit policy of each name
+ *
+ * Return: number of policies parsed, 0 if a name is unknown, there are more than MAX_POLICIES of them, or the
+ *         bench was built without BENCH_EXPLICIT
+ */
+size_t parse_policies(const char *list, int *policies) {
+#ifdef BENCH_EXPLICIT
+    static const char *names[MAX_POLICIES] = {"first", "best", "addr"};
+    static const int values[MAX_POLICIES] = {FIT_FIRST, FIT_BEST, FIT_ADDRESS};
+    size_t count = 0;
+    while(*list != '\0') {
+        size_t len = strcspn(list, ",");
+        size_t i = 0;
+        while(i < MAX_POLICIES && (strlen(names[i]) != len || strncmp(list, names[i], len) != 0)) {
+            i++;
+        }
+        if(i == MAX_POLICIES || count == MAX_POLICIES) {
+            return 0;
+        }
+        policies[count++] = values[i];
+        list += len + (list[len] == ',');
+    }
+    return count;
+#else
+    (void)list;
+    (void)policies;
+    return 0;
+#endif
+}
+​
+/* Function: policy_name
+ * ___________________
+ * Parameters:
+ *    - policy: fit policy parsed by parse_policies
+ *
+ * Return: the name -p knows it by
+ */
+const char *policy_name(int policy) {
+    static const char *names[MAX_POLICIES] = {"first", "best", "addr"};
+    return (policy >= 0 && policy < MAX_POLICIES) ? names[policy] : "?";
+}
+​
+/* Function: main
+ * ___________________
+ * Description: Parses the options, builds each workload's trace and either runs it (once per -p policy, labelled
+ *              "workload/policy") or, with -o, saves it.
+ */
+int main(int argc, char *argv[]) {
+    size_t heap_size = DEFAULT_HEAP_SIZE;
+    size_t nops = DEFAULT_OPS;
+    bool validate = false;
+    const char *out_path = NULL;
+    int policies[MAX_POLICIES];
+    size_t npolicies = 0;
+    int first = 1;
+
+    for(; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+        char flag = argv[first][1];
+        if(flag == 'v') {
+            validate = true;
+            continue;
+        }
+        if(first + 1 >= argc || (flag != 's' && flag != 'n' && flag != 'r' && flag != 'o' && flag != 'p')) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++first];
+        if(flag == 's') {
+            heap_size = strtoull(value, NULL, 0);
+        } else if(flag == 'n') {
+            nops = strtoull(value, NULL, 0);
+        } else if(flag == 'r') {
+            rng_state = strtoull(value, NULL, 0) | 1;
+        } else if(flag == 'p') {
+            if((npolicies = parse_policies(value, policies)) == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            out_path = value;
+        }
+    }
+    if(first == argc || (out_path != NULL && argc - first != 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    void *heap = mmap(NULL, heap_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(heap == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if(out_path == NULL) {
+        printf("%-16s %10s %14s %8s %8s %8s %10s %10s\n", "workload", "ops", "ops/sec", "p50(ns)", "p99(ns)", "p999(ns)", "peak util", "avg frag");
+    }
+
+    int status = 0;
+    for(int i = first; i < argc; i++) {
+        trace tr = {NULL, 0, 0, 0};
+        bool ok = true;
+        if(strcmp(argv[i], "producer") == 0) {
+            gen_producer(&tr, nops);
+        } else if(strcmp(argv[i], "powerlaw") == 0) {
+            gen_powerlaw(&tr, nops);
+        } else if(strcmp(argv[i], "realloc") == 0) {
+            gen_realloc(&tr, nops);
+        } else {
+            ok = load_trace(argv[i], &tr);
+        }
+
+        if(ok && out_path != NULL) {
+            ok = write_binary_trace(out_path, &tr);
+        } else if(ok && npolicies == 0) {
+            ok = run_workload(argv[i], &tr, heap, heap_size, validate);
+        }
+        for(size_t p = 0; ok && out_path == NULL && p < npolicies; p++) {
+            char label[64];
+            snprintf(label, sizeof(label), "%s/%s", argv[i], policy_name(policies[p]));
+#ifdef BENCH_EXPLICIT
+            config.fit_policy = policies[p];
+#endif
+            ok = run_workload(label, &tr, heap, heap_size, validate);
+        }
+        if(!ok) {
+            fprintf(stderr, "%s: failed\n", argv[i]);
+            status = 1;
+        }
+        free(tr.ops);
+    }
+    munmap(heap, heap_size);
+    return status;
+}
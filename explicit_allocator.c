@@ -3,18 +3,57 @@
  * explicit: This program is an implementation of an explicit free list heap allocator. In 
  *           terms of specs, this program uses headers to track block size and allocation 
  *           status (as well as the pointers to next and previous free blocks which are contained 
- *           in the "header" struct). Malloc uses this explicit free list created by the pointers 
- *           to find a new free block (using first fit). Coalescing of immediate right neighbors is 
- *           supported when free is called. Additionally, in-place realloc is supported and attempts 
- *           to merge neighboring right blocks to create enough room in the case of an expansion. 
- *           If the immediate neighboring space isn't large enough, realloc moves the block to another 
- *           part of the heap.
+ *           in the "header" struct). Free blocks are kept in segregated free lists, one per size 
+ *           class, and malloc searches the request's class first and then moves up to larger classes 
+ *           (first fit within a class, scanning a compact array of block sizes kept per class before it 
+ *           has to chase list links). Alternatively, larger free blocks can be kept in a splay tree 
+ *           keyed by size for O(log n) best fit, or the lists of larger blocks can be kept in address order 
+ *           (with a splay tree keyed by address per class to find each insertion point). The free block at the top of
+ *           each arena (the wilderness) stays off the lists and is only carved when nothing else fits. In deferred
+ *           coalescing mode, small blocks freed to an arena wait unmerged on exact-size quick lists until a merge pass
+ *           is needed. Free blocks also carry a footer (boundary tag) and each header records whether its left neighbor
+ *           is free, so free coalesces with both neighbors in O(1). Additionally, in-place realloc is supported and
+ *           attempts to merge neighboring right blocks to create enough room in the case of an expansion (reserving
+ *           geometric headroom for large blocks), then growing the arena under a block at its top, and finally sliding
+ *           the block into a free left neighbor. If the neighboring space isn't large enough, realloc moves the block
+ *           to another part of the heap. The segment can be split into several independent arenas, each 
+ *           under its own lock, with a per-thread cache of small blocks in front of them so most malloc 
+ *           and free calls never lock. Optionally, an arena that runs out of memory maps more with mmap,
+ *           extending its last chunk in place when the kernel puts the mapping right after it. Free list 
+ *           links can also be stored as 32-bit offsets, shrinking the minimum block to 16 bytes. Aligned 
+ *           allocations split the leading gap off as its own free block, and every block can optionally be 
+ *           16-byte aligned. Batches of same-sized blocks can be carved from one free block in a single pass
+ *           and freed together, merging neighbors within the batch before touching the free lists. Regions hand out
+ *           headerless blocks by bumping a pointer through one large block and give it back in a single free. Pools
+ *           keep fixed-size objects on intrusive free lists inside aligned chunks taken from the heap. Sized
+ *           frees use the caller's size to reach the thread cache without reading the block's header. mytrim
+ *           gives the pages inside large free blocks back to the kernel while their headers and links stay put, and
+ *           mycalloc skips clearing pages it knows are still zero (trimmed or never touched since mapping). mystats
+ *           reports a snapshot of the heap's layout along with per-thread call counters, mydump_layout streams 
+ *           every block's placement for offline fragmentation maps, and an optional sampling
+ *           profiler records the call stack of about one allocation per N bytes for pprof heap profiles.
  */
+#define _GNU_SOURCE
 #include "allocator.h"
+#include "explicit_allocator.h"
 #include "debug_break.h"
+#include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 ​
 ​
 //CONSTANTS:
@@ -22,22 +61,134 @@
 #define WIDTH 8
 #define ALLOC 1
 #define FREE 0
+#define PREV_FREE 0x2
+#define PREV_MIN 0x4
+#define MMAPPED 0x8
+#define DECOMMITTED 0x10
+#define FLAG_MASK 0x1F
+#define MIN_SIZE 16
+#define COMPACT_MIN_SIZE 8
+#define COMPACT_SPAN (1UL << 35)
+#define TCACHE_MAX 512
+#define TCACHE_BINS (TCACHE_MAX >> 3)
+#define TCACHE_COUNT 32
+#define TCACHE_BATCH 16
+#define NUM_CLASSES 128
+#define NUM_EXACT_CLASSES 15
+#define TREE_MIN 128
+#define SIDE_SLOTS 8
+#define REALLOC_GROWTH_MIN 1024
+#define QUICK_MAX 1024
+#define QUICK_BINS (QUICK_MAX >> 3)
+#define QUICK_LIMIT 256
+#define MAX_ARENAS 64
+#define MAX_REGIONS 256
+#define MAX_GROW_SIZE (1UL << 30)
+#define MAX_REQUEST (SIZE_MAX >> 4)
+#define STREAM_CLEAR_MIN (256UL << 10)
+#define SLAB_SIZE 4096
+#define SLAB_MAX 64
+#define SLAB_CLASSES (SLAB_MAX / WIDTH)
+#define SLAB_WORDS 8
+#define HUGE_PAGE_SIZE (2UL << 20)
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0
+#endif
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0
+#endif
+#define MAX_NODES 64
+#define MAX_CPUS 1024
+#define MPOL_PREFERRED 1
+#define PROFILE_SLOTS (1 << 15)
+#define PROFILE_PROBES 16
+#define PROFILE_DEPTH 32
+#define PROFILE_RECHECK (64UL << 10)
+#define PROFILE_TOMBSTONE ((void *)1)
+#define LAYOUT_BATCH 512
+#define POOL_CHUNK (64UL << 10)
+#define POOL_MIN_SLOTS 16
+​
+/* COMPILE-TIME CONFIGURATION:
+ * ___________________________
+ * Each of these can be fixed with -D when the allocator is built. A fixed setting replaces the global of the same 
+ * purpose with a constant, so the compiler drops the code for every other choice from the hot paths, and the 
+ * matching allocator_config field is ignored. Different services can link differently specialized builds.
+ * HEAP_ALIGN: block_align (8 or 16)
+ * HEAP_FIT_POLICY: fit_policy (FIT_FIRST, FIT_BEST or FIT_ADDRESS)
+ * HEAP_COMPACT_LINKS: compact_links (0 or 1)
+ * HEAP_DEFER_COALESCE: defer_coalesce (0 or 1)
+ * HEAP_CLASS_BITS: log2 of the number of size classes each power of two from 128 bytes up is split into (default 2)
+ * HEAP_SINGLE_THREADED: compile the arena locks out, for programs that only call the allocator from one thread
+ */
+#if defined(HEAP_ALIGN) && HEAP_ALIGN != 8 && HEAP_ALIGN != 16
+#error "HEAP_ALIGN must be 8 or 16"
+#endif
+#if defined(HEAP_FIT_POLICY) && (HEAP_FIT_POLICY < FIT_FIRST || HEAP_FIT_POLICY > FIT_ADDRESS)
+#error "HEAP_FIT_POLICY must be FIT_FIRST, FIT_BEST or FIT_ADDRESS"
+#endif
+#ifndef HEAP_CLASS_BITS
+#define HEAP_CLASS_BITS 2
+#endif
+#if HEAP_CLASS_BITS < 0 || HEAP_CLASS_BITS > 4
+#error "HEAP_CLASS_BITS must be between 0 and 4"
+#endif
+#define CLASS_SPLIT (1 << HEAP_CLASS_BITS)
+#ifdef HEAP_SINGLE_THREADED
+#define lock_arena(ar) ((void)(ar))
+#define unlock_arena(ar) ((void)(ar))
+#else
+#define lock_arena(ar) pthread_mutex_lock(&(ar)->lock)
+#define unlock_arena(ar) pthread_mutex_unlock(&(ar)->lock)
+#endif
 ​
 /* GLOBAL VARIABLES:
  * _________________
- * segment_start: beginning of heap segment
- * segment_size: total size of heap segment
- * start_block: first block in segment (initialized to start + 8 bytes)
- * nblocks: total number of blocks (free and allocated)
- * nused: total number of allocated blocks
- * last_free_block: most recent free block appended to explicit free list
+ * arenas: the independent slices of the heap segment, each with its own free lists and lock
+ * narenas: number of arenas in use (1 unless myinit_config asked for more)
+ * arena_span: size of every arena but the last (the last one also takes whatever is left over)
+ * heap_base / heap_end: bounds of the heap segment passed to myinit
+ * regions: every range mapped by grow_arena and the arena it belongs to (only ever appended to until myinit)
+ * nregions: number of entries in regions (published with a release store so arena_of can read it unlocked)
+ * region_lock: serializes arenas appending to regions
+ * arena_select: how threads pick their home arena (ARENA_ROUND_ROBIN or ARENA_BY_CPU)
+ * next_arena: round-robin counter used to hand out home arenas
+ * heap_generation: bumped by every myinit so threads can tell their cached blocks came from an older heap
+ * page_size: system page size, the granularity of every mapping
+ * huge_pages: back the segment, growth chunks, slabs and big MMAPPED blocks with 2 MB pages where the system allows
+ * numa_nodes: number of NUMA nodes the arenas are spread over (arena i lives on node i % numa_nodes), 0 when 
+ *             myinit_config wasn't asked to place arenas by node
+ * cpu_node: node of each CPU, read from sysfs by load_numa_topology
+ * trim_granule: granularity of trim_range (page_size, or HUGE_PAGE_SIZE with huge_pages so that trimming never 
+ *               splits a huge page)
+ * mmap_threshold: rounded requests at least this big get their own mapping (0 disables the mmap path)
+ * check_interval: average number of frees between two sampled checks of the freed block (0 disables sampling)
+ * fit_policy: FIT_FIRST (segregated lists only), FIT_BEST (free blocks of at least TREE_MIN bytes in a size tree) 
+ *             or FIT_ADDRESS (lists of blocks of at least TREE_MIN bytes sorted by address)
+ * defer_coalesce: small blocks freed to an arena go on its quick lists instead of being coalesced right away
+ * compact_links: free list links are 32-bit offsets from heap_base (see compact_header)
+ * min_size / min_block: smallest block payload (MIN_SIZE or COMPACT_MIN_SIZE, rounded so the block keeps 
+ *                       block_align) and smallest whole block, which is also the smallest leftover worth 
+ *                       splitting off
+ * block_align: alignment of every payload (8, or 16 when myinit_config asked for it). Every block then spans a
+ *              multiple of block_align bytes, header included, so payloads stay aligned through splits and merges
+ * slab_base / slab_limit: start of the address range reserved for slabs and the number of slabs it holds
+ *                         (slab_limit is 0 when slabs are disabled)
+ * slab_count: number of slabs handed out so far (bump index into the slab range)
+ * slab_current: per slab class, the slab new slots are claimed from
+ * slab_partial: per slab class, tagged head of the stack of other slabs that have free slots
+ * mmap_bytes: bytes currently mapped for MMAPPED blocks
+ * counts_list / counts_lock: every live thread's call_counts, so mystats can add them up
+ * retired_counts: call counts of threads that exited since the last myinit
+ * cursor / cursor_lock: where validate_heap_step resumes, and the lock that serializes calls to it
+ * profile_table: open-addressed table of the live sampled blocks, mapped by the first myprofile_start
+ * profile_interval: mean number of bytes between two samples (0 when the profiler is off)
+ * profile_live / profile_dropped: number of blocks in profile_table, and of samples that found no free slot
+ * profile_lock: serializes changes to profile_table (frees look blocks up without it)
+ * sample_left / sample_seed / in_profile: per thread, the bytes left until the next sample, the state of the
+ *                                         generator that draws the gaps, and whether the thread is inside
+ *                                         profile_sample (so the allocations backtrace makes aren't sampled)
  */
-static void *segment_start;
-static size_t segment_size;
-static void* start_block;
-static size_t nblocks;
-static size_t nused;
-static void *last_free_block;
 ​
 ​
 //STRUCT INFO
@@ -46,7 +197,13 @@ static void *last_free_block;
 /* Struct: Header
  * ______________
  * Description: The "header" struct is 24-bytes big and contains 8-bytes for the block size and 8 bytes each
- *              for the next and previous free block pointers.
+ *              for the next and previous free block pointers. The low bits of block_size hold ALLOC, PREV_FREE
+ *              (left neighbor is free) and PREV_MIN (left neighbor is a free min_size block). Free blocks bigger
+ *              than min_size also end in an 8-byte footer repeating their size, which is how a block finds the
+ *              header of a free left neighbor. min_size blocks have no room for a footer, hence PREV_MIN. Blocks
+ *              served directly by mmap set MMAPPED and sit alone at the start of their own mapping. A free block 
+ *              with DECOMMITTED set has only zero-filled pages in its trim_range (given back by mytrim, or never
+ *              touched since they were mapped), which mycalloc doesn't need to clear.
  */
 typedef struct {
     size_t block_size;
@@ -54,26 +211,302 @@ typedef struct {
     void *next_ptr;
 } header;
 ​
+/* Struct: compact_header
+ * ______________________
+ * Description: The "compact_header" struct is the header layout used when compact_links is set. The links are
+ *              the distance from heap_base to the linked block in 8-byte words (0 meaning NULL, which no block 
+ *              can be), so they reach blocks up to COMPACT_SPAN bytes past heap_base and fit a free block's 
+ *              payload in 8 bytes. That lets the minimum block shrink to COMPACT_MIN_SIZE plus the size word.
+ *              Only the get/set link helpers know which layout is in use.
+ */
+typedef struct {
+    size_t block_size;
+    uint32_t prev_off;
+    uint32_t next_off;
+} compact_header;
+​
+/* Struct: tree_node
+ * _________________
+ * Description: The "tree_node" struct extends the header of a free block that lives in an arena's size_tree. Blocks
+ *              of equal size form one chain through the free list links and only the first block of the chain 
+ *              (the one with a NULL prev link) is linked into the tree through left and right, which are 
+ *              meaningless in the rest of the chain. With FIT_ADDRESS there is no size tree and left and right 
+ *              link the blocks of a class into its address tree instead, while the free list links keep them 
+ *              sorted by address. Tree blocks are at least TREE_MIN bytes, so the two extra 
+ *              pointers and the footer always fit in the payload, whichever link layout is in use.
+ */
+typedef struct {
+    header hdr;
+    void *left;
+    void *right;
+} tree_node;
+​
+/* Struct: side_array
+ * __________________
+ * Description: The "side_array" struct mirrors up to SIDE_SLOTS blocks of one multi-size free list (the classes 
+ *              from NUM_EXACT_CLASSES up) as (size, block) pairs, so first_fit can compare sizes in one linear scan
+ *              of the arena's own memory instead of loading a header in some random part of the segment for each
+ *              list hop. Entries are unordered and removed by swapping the last one in.
+ *    - sizes / blocks: size and address of each mirrored block
+ *    - count: number of entries in use
+ *    - overflow: a block was put on the list while the array was full, so the list may hold blocks the array 
+ *                doesn't (cleared when the list empties). While it's false, the array is the whole list.
+ */
+typedef struct {
+    size_t sizes[SIDE_SLOTS];
+    void *blocks[SIDE_SLOTS];
+    uint32_t count;
+    bool overflow;
+} side_array;
+​
+/* Struct: chunk
+ * _____________
+ * Description: The "chunk" struct describes one contiguous run of blocks, from start_block up to the epilogue at
+ *              segment_end. An arena starts with a single chunk (its slice of the segment) and grow_arena adds one
+ *              for each mapping that couldn't be placed right after the previous one. Mapped chunks store their
+ *              chunk struct in the first bytes of the mapping.
+ */
+typedef struct chunk {
+    void *start_block;
+    void *segment_end;
+    struct chunk *next;
+} chunk;
+​
+/* Struct: region
+ * ______________
+ * Description: The "region" struct records one range mapped by grow_arena so that arena_of can map block 
+ *              addresses outside the original segment back to their arena.
+ */
+typedef struct {
+    void *start;
+    void *end;
+    struct arena *owner;
+} region;
+​
+/* Struct: arena
+ * _____________
+ * Description: The "arena" struct holds the state of one independent slice of the heap segment: its chunks (each
+ *              with its own first block and epilogue), block counters, segregated free lists and the lock that 
+ *              guards all of them. Each arena is cache-line aligned so threads working in different arenas never 
+ *              share a metadata line.
+ *    - base: the arena's slice of the segment
+ *    - top: most recently added chunk, the one grow_arena tries to extend in place
+ *    - grow_size: size of the next mapping grow_arena makes (0 when growth is disabled)
+ *    - nblocks / nused: total number of blocks, number of allocated blocks
+ *    - free_lists: head of the explicit free list for each size class (most recently freed block first)
+ *    - class_map: bitmap of non-empty size classes (bit i is set when free_lists[i] != NULL)
+ *    - sides: side_array of each class from NUM_EXACT_CLASSES up (entry cls - NUM_EXACT_CLASSES)
+ *    - addr_trees: with FIT_ADDRESS, root of the address-keyed splay tree over each of those classes' lists
+ *    - size_tree: root of the splay tree of free blocks of at least TREE_MIN bytes (FIT_BEST only)
+ *    - wilderness: free block right before the top chunk's epilogue, kept off the free lists (NULL if the top 
+ *                  chunk ends in an allocated block)
+ *    - quick / nquick: with defer_coalesce, exact-size stacks of freed blocks of up to QUICK_MAX bytes that are
+ *                      still marked allocated (linked through their first word), and how many blocks they hold
+ *    - node: NUMA node the arena's memory is bound to (0 unless numa_nodes is set)
+ *    - remote_frees: lock-free stack of blocks freed by threads living in other arenas, still marked allocated
+ *                    and linked through their first word (the only field touched without holding lock)
+ *    - coalesces / splits: number of neighbor merges done by coalesce and of free blocks split by an allocation
+ *    - merges: number of times a block start disappeared into the block on its left (every drop in nblocks, and
+ *              each time an in-place realloc took the front of a free neighbor), which tells validate_heap_step
+ *              whether the block its cursor points at may no longer exist
+ *    - searches / probes: number of fit searches and of free blocks they looked at
+ */
+typedef struct arena {
+    pthread_mutex_t lock;
+    chunk base;
+    chunk *top;
+    size_t grow_size;
+    size_t nblocks;
+    size_t nused;
+    uint64_t class_map[NUM_CLASSES / 64];
+    void *free_lists[NUM_CLASSES];
+    side_array sides[NUM_CLASSES - NUM_EXACT_CLASSES];
+    void *addr_trees[NUM_CLASSES - NUM_EXACT_CLASSES];
+    void *size_tree;
+    void *wilderness;
+    void *quick[QUICK_BINS];
+    size_t nquick;
+    int node;
+    void *remote_frees;
+    size_t coalesces;
+    size_t splits;
+    size_t merges;
+    size_t searches;
+    size_t probes;
+} __attribute__((aligned(64))) arena;
+
+static arena arenas[MAX_ARENAS];
+static size_t narenas;
+static size_t arena_span;
+static void *heap_base;
+static void *heap_end;
+static region regions[MAX_REGIONS];
+static size_t nregions;
+static pthread_mutex_t region_lock = PTHREAD_MUTEX_INITIALIZER;
+static int arena_select;
+static size_t next_arena;
+static unsigned long heap_generation;
+static size_t page_size;
+static bool huge_pages;
+static size_t numa_nodes;
+static uint8_t cpu_node[MAX_CPUS];
+static size_t trim_granule;
+static size_t mmap_threshold;
+static size_t check_interval;
+#ifdef HEAP_FIT_POLICY
+#define fit_policy HEAP_FIT_POLICY
+#else
+static int fit_policy;
+#endif
+#ifdef HEAP_DEFER_COALESCE
+#define defer_coalesce ((bool)HEAP_DEFER_COALESCE)
+#else
+static bool defer_coalesce;
+#endif
+#ifdef HEAP_COMPACT_LINKS
+#define compact_links ((bool)HEAP_COMPACT_LINKS)
+#else
+static bool compact_links;
+#endif
+static size_t min_size = MIN_SIZE;
+static size_t min_block = MIN_SIZE + WIDTH;
+#ifdef HEAP_ALIGN
+#define block_align ((size_t)HEAP_ALIGN)
+#else
+static size_t block_align = WIDTH;
+#endif
+static void *slab_base;
+static size_t slab_limit;
+static size_t slab_count;
+static struct slab *slab_current[SLAB_CLASSES];
+static uint64_t slab_partial[SLAB_CLASSES];
+static size_t mmap_bytes;
+​
+/* Struct: slab
+ * ____________
+ * Description: The "slab" struct sits at the start of each SLAB_SIZE-aligned slab and is followed by nslots slots
+ *              of slot_size bytes, none of which have a header (the slab is found by masking a slot's address). A set
+ *              bit in bitmap means the slot is free. Slots are claimed and released with atomic operations on the
+ *              bitmap, so no lock is ever taken. next and listed link the slab into its class's slab_partial stack.
+ */
+typedef struct slab {
+    uint64_t bitmap[SLAB_WORDS];
+    uint32_t next;
+    uint32_t listed;
+    uint32_t slot_size;
+    uint32_t nslots;
+} slab;
+​
 /* Function: create_hdr
  * ____________________
  * Parameters:
  *    - loc: pointer to starting location of header
  *    - size: size of block (not including header) in bytes
- *    - prev: pointer to previous free block
- *    - next: pointer to next free block
  *
  * Return: N/A
  *
- * Description: This function writes a new header into memory, setting the size, next pointer, and previous pointer.
+ * Description: This function writes a new header into memory, setting the size and clearing every flag. The free
+ *              list links are left alone: every new free block goes through insert_free, which sets them, and a 
+ *              min_size block may not have room for full pointers.
  */
-void create_hdr(void *loc, size_t size, void *prev, void *next) {
+void create_hdr(void *loc, size_t size) {
     header *h = loc;
     h->block_size = (size << 2);
-    h->prev_ptr = prev;
-    h->next_ptr = next;
 }
 ​
 ​
+/* Struct: tcache
+ * ______________
+ * Description: The "tcache" struct is one thread's private cache of small blocks, with one bin per exact block size
+ *              up to TCACHE_MAX (see get_tcache_bin). Cached blocks stay allocated as far as the
+ *              shared heap is concerned and are chained through their first payload word. home is the arena the
+ *              thread allocates from (blocks freed by the thread may come from any arena). Each thread gets its own
+ *              copy (thread_cache), so mymalloc and myfree never lock on a cache hit.
+ *              check_countdown is the number of frees left until the next sampled check and check_seed the
+ *              state of the xorshift generator that spaces the checks out.
+ */
+typedef struct {
+    unsigned long generation;
+    arena *home;
+    size_t check_countdown;
+    uint32_t check_seed;
+    int counts[TCACHE_BINS];
+    void *bins[TCACHE_BINS];
+} tcache;
+
+static __thread tcache thread_cache;
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+​
+/* Struct: call_counts
+ * ___________________
+ * Description: The "call_counts" struct holds one thread's counts of calls into the allocator. Only the owning 
+ *              thread writes them (with relaxed atomic stores, so an increment is still a plain add), which keeps 
+ *              counting off the shared cache lines. Every thread's copy is linked into counts_list the first time 
+ *              it is used and unlinked (its totals moved to retired_counts) when the thread exits. generation 
+ *              works like the tcache's: counts from before the last myinit are reset on the next call.
+ */
+typedef struct call_counts {
+    unsigned long generation;
+    size_t mallocs;
+    size_t frees;
+    size_t reallocs;
+    size_t reallocs_in_place;
+    size_t reallocs_moved;
+    bool registered;
+    struct call_counts *prev;
+    struct call_counts *next;
+} call_counts;
+
+static __thread call_counts thread_counts;
+static call_counts *counts_list;
+static call_counts retired_counts;
+static pthread_mutex_t counts_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t counts_key;
+static pthread_once_t counts_once = PTHREAD_ONCE_INIT;
+​
+/* Struct: check_cursor
+ * ____________________
+ * Description: The "check_cursor" struct records where validate_heap_step stopped: the arena, the chunk and the
+ *              block to check next (NULL to start over at the chunk's first block), with the arena's merges
+ *              count at the time so a block that has since been merged away is never read as a header.
+ *              generation resets the cursor after myinit.
+ */
+typedef struct {
+    unsigned long generation;
+    size_t arena;
+    chunk *ch;
+    void *block;
+    size_t merges;
+} check_cursor;
+
+static check_cursor cursor;
+static pthread_mutex_t cursor_lock = PTHREAD_MUTEX_INITIALIZER;
+​
+/* Struct: heap_sample
+ * ___________________
+ * Description: The "heap_sample" struct is one slot of profile_table: a sampled block that is still live, the
+ *              size it was requested with and the return addresses of the call that allocated it (innermost 
+ *              first). ptr is NULL for a slot that was never used and PROFILE_TOMBSTONE for one whose block has 
+ *              been freed, so lookups know to keep probing past it.
+ */
+typedef struct {
+    void *ptr;
+    size_t size;
+    int depth;
+    void *stack[PROFILE_DEPTH];
+} heap_sample;
+
+static heap_sample *profile_table;
+static size_t profile_interval;
+static size_t profile_live;
+static size_t profile_dropped;
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread size_t sample_left;
+static __thread uint64_t sample_seed;
+static __thread bool in_profile;
+​
+​
 //SHORT HELPER FUNCTIONS:
 //_______________________
 ​
@@ -101,7 +534,7 @@ header *get_hdr(void *block_ptr) {
  * Description: This function takes a pointer to the start of a block and returns the size of that block.
  */
 size_t get_block_size(void *block_ptr) {
-    return ((*get_hdr(block_ptr)).block_size) >> 2;
+    return ((*get_hdr(block_ptr)).block_size & ~FLAG_MASK) >> 2;
 }
 ​
 /* Functions: get_next_block
@@ -118,6 +551,58 @@ void *get_next_block(void *block_ptr) {
     return (char *)block_ptr + get_block_size(block_ptr) + WIDTH;
 }
 ​
+/* Functions: check_prev_free
+ * __________________
+ * Parameters:
+ *    - block_ptr: pointer to start of block
+ *
+ * Return: true if the neighboring left block is free, false otherwise
+ *
+ * Description: This function reads the PREV_FREE bit out of the block's header.
+ */
+bool check_prev_free(void *block_ptr) {
+    return (*get_hdr(block_ptr)).block_size & PREV_FREE;
+}
+​
+/* Functions: get_prev_block
+ * __________________
+ * Parameters:
+ *    - block_ptr: pointer to start of block whose left neighbor is free
+ *
+ * Return: pointer to the neighboring left block
+ *
+ * Description: This function finds the start of the free block to the left, either from the footer that sits just
+ *              before block_ptr's header or, when PREV_MIN is set, from the fixed min_size. It is only valid when
+ *              check_prev_free(block_ptr) is true (allocated blocks have no footer).
+ */
+void *get_prev_block(void *block_ptr) {
+    header *hdr_ptr = get_hdr(block_ptr);
+    size_t prev_size = ((*hdr_ptr).block_size & PREV_MIN) ? min_size : *((size_t *)hdr_ptr - 1);
+    return (char *)hdr_ptr - prev_size;
+}
+​
+/* Functions: to_offset
+ * __________________
+ * Parameters:
+ *    - block_ptr: pointer to start of block in the compact link window (or NULL)
+ *
+ * Return: the block's compact link (its distance from heap_base in words, 0 for NULL)
+ */
+uint32_t to_offset(void *block_ptr) {
+    return (block_ptr != NULL) ? (uint32_t)(((char *)block_ptr - (char *)heap_base) / WIDTH) : 0;
+}
+​
+/* Functions: from_offset
+ * __________________
+ * Parameters:
+ *    - offset: compact link
+ *
+ * Return: pointer to start of the linked block, NULL for a 0 link
+ */
+void *from_offset(uint32_t offset) {
+    return (offset != 0) ? (char *)heap_base + (size_t)offset * WIDTH : NULL;
+}
+​
 /* Functions: get_next_free
  * __________________
  * Parameters:
@@ -129,7 +614,10 @@ void *get_next_block(void *block_ptr) {
  *              free block.
  */
 void *get_next_free(void *block_ptr) {
-    return (block_ptr != NULL) ? (*get_hdr(block_ptr)).next_ptr : NULL;
+    if(block_ptr == NULL) {
+        return NULL;
+    }
+    return compact_links ? from_offset((*(compact_header *)get_hdr(block_ptr)).next_off) : (*get_hdr(block_ptr)).next_ptr;
 }
 ​
 /* Functions: get_prev_free
@@ -143,7 +631,10 @@ void *get_next_free(void *block_ptr) {
  *              block.
  */
 void *get_prev_free(void *block_ptr) {
-    return (block_ptr != NULL) ? (*get_hdr(block_ptr)).prev_ptr : NULL;
+    if(block_ptr == NULL) {
+        return NULL;
+    }
+    return compact_links ? from_offset((*(compact_header *)get_hdr(block_ptr)).prev_off) : (*get_hdr(block_ptr)).prev_ptr;
 }
 ​
 /* Functions: check_alloc
@@ -168,10 +659,75 @@ int check_alloc(void *block_ptr) {
  * Return: rounded up version of original request (to nearest multiple of 8)
  *
  * Description: This function rounds up the client's request size to the nearest multiple of 8 and returns that number.
+ *              With 16-byte block_align, the size is rounded so that header plus payload is a multiple of 16.
  */
 size_t round_up(size_t req_size){
-    size_t rounded_size = (req_size + WIDTH - 1) & ~(WIDTH - 1);
-    return (rounded_size < 16) ? 16 : rounded_size;
+    size_t rounded_size = ((req_size + WIDTH + block_align - 1) & ~(block_align - 1)) - WIDTH;
+    return (rounded_size < min_size) ? min_size : rounded_size;
+}
+​
+/* Functions: page_round
+ * __________________
+ * Parameters:
+ *    - len: length of a mapping in bytes
+ *
+ * Return: len rounded up to a multiple of the page size
+ */
+size_t page_round(size_t len) {
+    return (len + page_size - 1) & ~(page_size - 1);
+}
+​
+/* Function: trim_range
+ * ___________________
+ * Parameters:
+ *    - block_ptr: free block
+ *    - start / end: set to the range of whole pages (of trim_granule bytes) inside the block that hold no metadata
+ *
+ * Return: true if that range holds at least one page
+ *
+ * Description: A free block's header, free list or tree links (at most a tree_node from the header on) and footer
+ *              have to stay resident, so only the pages strictly between the links and the footer can go.
+ */
+bool trim_range(void *block_ptr, char **start, char **end) {
+    uintptr_t first = (uintptr_t)get_hdr(block_ptr) + sizeof(tree_node);
+    uintptr_t last = (uintptr_t)block_ptr + get_block_size(block_ptr) - WIDTH;
+    *start = (char *)((first + trim_granule - 1) & ~(uintptr_t)(trim_granule - 1));
+    *end = (char *)(last & ~(uintptr_t)(trim_granule - 1));
+    return *end > *start;
+}
+​
+/* Function: clear_range
+ * ___________________
+ * Parameters:
+ *    - start / end: bytes to zero
+ *
+ * Return: N/A
+ *
+ * Description: Ranges of at least STREAM_CLEAR_MIN bytes are cleared with non-temporal 16-byte stores where SSE2 is
+ *              available, so zeroing a big buffer doesn't push the rest of the working set out of the cache. 
+ *              Anything smaller is a plain memset.
+ */
+void clear_range(char *start, char *end) {
+    if(end <= start) {
+        return;
+    }
+#ifdef __SSE2__
+    if((size_t)(end - start) >= STREAM_CLEAR_MIN) {
+        char *body = (char *)(((uintptr_t)start + 15) & ~(uintptr_t)15);
+        __m128i zero = _mm_setzero_si128();
+        memset(start, 0, body - start);
+        for(; body + 64 <= end; body += 64) {
+            _mm_stream_si128((__m128i *)body, zero);
+            _mm_stream_si128((__m128i *)(body + 16), zero);
+            _mm_stream_si128((__m128i *)(body + 32), zero);
+            _mm_stream_si128((__m128i *)(body + 48), zero);
+        }
+        _mm_sfence();
+        memset(body, 0, end - body);
+        return;
+    }
+#endif
+    memset(start, 0, end - start);
 }
 ​
 /* Functions: set_hdr_size
@@ -186,7 +742,7 @@ size_t round_up(size_t req_size){
  */
 void set_hdr_size(void *block_ptr, size_t upd_size){
     header *hdr_ptr = get_hdr(block_ptr);
-    (*hdr_ptr).block_size = ((*hdr_ptr).block_size & 0x3) | (upd_size << 2);
+    (*hdr_ptr).block_size = ((*hdr_ptr).block_size & FLAG_MASK) | (upd_size << 2);
 }
 ​
 /* Functions: set_hdr_status
@@ -201,7 +757,29 @@ void set_hdr_size(void *block_ptr, size_t upd_size){
  */
 void set_hdr_status(void *block_ptr, unsigned long status) {
     header *hdr_ptr = get_hdr(block_ptr);
-    (*hdr_ptr).block_size = ((*hdr_ptr).block_size & ~0x3) | status;
+    (*hdr_ptr).block_size = ((*hdr_ptr).block_size & ~ALLOC) | status;
+}
+​
+/* Functions: set_prev_status
+ * __________________
+ * Parameters:
+ *    - block_ptr: pointer to start of block
+ *    - status: FREE (0) or ALLOC (1), status of the neighboring left block
+ *    - prev_size: size of the neighboring left block (only read when status is FREE)
+ *
+ * Return: N/A
+ *
+ * Description: This function updates the PREV_FREE and PREV_MIN bits of the block's header to describe its left 
+ *              neighbor. The block may be allocated to another thread that is reading its size in myfree without
+ *              holding the arena lock, so the bits are flipped with atomic read-modify-writes.
+ */
+void set_prev_status(void *block_ptr, unsigned long status, size_t prev_size) {
+    header *hdr_ptr = get_hdr(block_ptr);
+    __atomic_fetch_and(&(*hdr_ptr).block_size, ~(size_t)(PREV_FREE | PREV_MIN), __ATOMIC_RELAXED);
+    if(status == FREE) {
+        size_t bits = PREV_FREE | ((prev_size == min_size) ? PREV_MIN : 0);
+        __atomic_fetch_or(&(*hdr_ptr).block_size, bits, __ATOMIC_RELAXED);
+    }
 }
 ​
 /* Functions: set_prev_ptr
@@ -216,7 +794,9 @@ void set_hdr_status(void *block_ptr, unsigned long status) {
  *              block pointer is NULL, the function does nothing.
  */
 void set_prev_ptr(void *block_ptr, void *prev) {
-    if(block_ptr != NULL) {
+    if(block_ptr != NULL && compact_links) {
+        (*(compact_header *)get_hdr(block_ptr)).prev_off = to_offset(prev);
+    } else if(block_ptr != NULL) {
         header *hdr_ptr = get_hdr(block_ptr);
         (*hdr_ptr).prev_ptr = prev;
     }
@@ -234,393 +814,4578 @@ void set_prev_ptr(void *block_ptr, void *prev) {
  *              block pointer is NULL, the function does nothing.
  */
 void set_next_ptr(void *block_ptr, void *next) {
-    if(block_ptr != NULL) {
+    if(block_ptr != NULL && compact_links) {
+        (*(compact_header *)get_hdr(block_ptr)).next_off = to_offset(next);
+    } else if(block_ptr != NULL) {
         header *hdr_ptr = get_hdr(block_ptr);
         (*hdr_ptr).next_ptr = next;
     }
 }
 ​
-/* Functions: upd_last_free_block
+/* Functions: get_class
  * __________________
  * Parameters:
- *    - cmp_block: block being checked (whether or not it was the last_free_block)
- *    - new_block: block to be set to last_free_block if cmp_block was the last_free_block
+ *    - size: size of block (not including header) in bytes
  *
- * Return: N/A
+ * Return: index of the size class the block belongs to
  *
- * Description: This function is used to check if the last_free_block is being allocated and if so, will update the 
- *              last_free_block (setting it equal to the passed in new_block).
+ * Description: Blocks under 128 bytes get one class per 8-byte size. Larger blocks are bucketed by power of two,
+ *              with each power of two split into CLASS_SPLIT sub-classes (4 unless HEAP_CLASS_BITS says 
+ *              otherwise). Blocks past the last class all land in that class.
  */
-void upd_last_free_block(void *cmp_block, void *new_block) {
-    if(last_free_block == cmp_block) {
-        last_free_block = new_block;
+int get_class(size_t size) {
+    if(size < 128) {
+        return (size >> 3) - 1;
     }
+    int log2 = 63 - __builtin_clzl(size);
+    int cls = NUM_EXACT_CLASSES + (log2 - 7) * CLASS_SPLIT + ((size >> (log2 - HEAP_CLASS_BITS)) & (CLASS_SPLIT - 1));
+    return (cls < NUM_CLASSES) ? cls : NUM_CLASSES - 1;
 }
 ​
-​
-//LONG HELPER FUNCTIONS:
-//______________________
-​
-/* Function: first_fit
- * ___________________
+/* Functions: get_quick_bin
+ * __________________
  * Parameters:
- *    - req_size: requested block size
+ *    - size: block size (<= QUICK_MAX)
+ *
+ * Return: index of the arena quick list holding blocks of exactly that size
+ */
+int get_quick_bin(size_t size) {
+    return (size >> 3) - 1;
+}
+
+/* Functions: next_nonempty_class
+ * __________________
+ * Parameters:
+ *    - ar: arena whose size classes are scanned
+ *    - cls: first size class to consider
  *
- * Return: pointer to first free block in explicit free list OR NULL if no block found
+ * Return: index of the first non-empty size class >= cls, -1 if every such class is empty
  *
- * Description: This function starts at the most recently appended block in the free list (last_free_block) and loops
- *              through that list, searching for the free block that meets the size requirements. If no free block 
- *              big enough for the request is found, NULL is returned.
+ * Description: This function scans ar->class_map instead of the lists themselves, so finding the next class with a
+ *              free block costs a couple of bit operations no matter how many classes are empty.
  */
-void *first_fit(size_t req_size) {
-    void *curr_block = last_free_block;
-    for(int i = 0; i < nblocks - nused; i++) {
-        if(get_block_size(curr_block) >= req_size && !check_alloc(curr_block)) {
-            return curr_block;
+int next_nonempty_class(arena *ar, int cls) {
+    for(int word = cls >> 6; word < NUM_CLASSES / 64; word++) {
+        uint64_t bits = ar->class_map[word];
+        if(word == (cls >> 6)) {
+            bits &= ~0ULL << (cls & 63);
+        }
+        if(bits) {
+            return (word << 6) + __builtin_ctzll(bits);
         }
-        curr_block = get_prev_free(curr_block);
     }
-    return curr_block;
+    return -1;
 }
-​
-/* Function: create_partial_fb
- * ___________________
+
+/* Functions: get_node
+ * __________________
  * Parameters:
- *    - orig_block: pointer to start of free block about to be allocated
- *    - new_fb:     pointer to start of remaining piece of free block (i.e. start of block + size request)
- *    - fb_size:    size of remaining piece of free block
- *
- * Return: N/A
+ *    - block_ptr: pointer to start of a free block in a size tree
  *
- * Description: This function is called during alloc and realloc requests when a free block will not be fully allocated.
- *              It rearranges the original free block's next and previous free block pointers to point to start of the 
- *              remaining "free block piece."
+ * Return: pointer to the block's header viewed as a tree_node
  */
-void create_partial_fb(void *orig_block, void *new_fb, size_t fb_size) {
-    void *new_free_hdr = get_hdr(new_fb);
-    void *orig_prev = get_prev_free(orig_block);
-    void *orig_next = get_next_free(orig_block);
-​
-    set_next_ptr(orig_prev, new_fb);
-    set_prev_ptr(orig_next, new_fb);
-    create_hdr(new_free_hdr, fb_size, orig_prev, orig_next);
-​
-    upd_last_free_block(orig_block, new_fb);
+tree_node *get_node(void *block_ptr) {
+    return (tree_node *)get_hdr(block_ptr);
 }
 ​
-/* Function: change_to_free
- * ___________________
+/* Functions: uses_tree
+ * __________________
  * Parameters:
- *    - new_free: pointer to block being freed
+ *    - size: size of a free block
  *
- * Return: N/A
- *
- * Description: This function is used for free and shink realloc requests. It sets the status of the new block to free, 
- *              sets its prev_ptr to the previously freed block, sets its next_ptr to NULL, and makes the new block the 
- *              last_free_block.
+ * Return: true if blocks of this size go in the size tree rather than a segregated list
  */
-void change_to_free(void *new_free) {
-    set_hdr_status(new_free, FREE);
-    set_next_ptr(last_free_block, new_free);
-    set_prev_ptr(new_free, last_free_block);
-    set_next_ptr(new_free, NULL);
-    last_free_block = new_free;
+bool uses_tree(size_t size) {
+    return fit_policy == FIT_BEST && size >= TREE_MIN;
 }
 ​
-/* Function: coalesce
- * ___________________
+/* Functions: uses_addr_order
+ * __________________
  * Parameters:
- *    - new_free: pointer to block being freed
+ *    - size: size of a free block
  *
- * Return: N/A
+ * Return: true if blocks of this size are kept in address order (their class's list is then also indexed by 
+ *         an address tree)
+ */
+bool uses_addr_order(size_t size) {
+    return fit_policy == FIT_ADDRESS && size >= TREE_MIN;
+}
+​
+/* Functions: node_key
+ * __________________
+ * Parameters:
+ *    - block_ptr: pointer to start of a free block in a tree
  *
- * Description: This function is called on each free request after it has been confirmed that in-place realloc has enough
- *              space. It sets the size of the freed block to account for the added size of its neighbor and rearranges
- *              the pointers for the two blocks given that the two blocks are now merged under one block.
+ * Return: the key the block is sorted by, its address with FIT_ADDRESS and its size otherwise
  */
-void coalesce(void *new_free) {
-    void *neighbor = get_next_block(new_free);
-    void *neighbor_prev = get_prev_free(neighbor);
-    void *neighbor_next = get_next_free(neighbor);
-    
-    set_hdr_status(new_free, FREE);
-    set_hdr_size(new_free, get_block_size(new_free) + get_block_size(neighbor) + WIDTH);
-    
-    set_prev_ptr(new_free, neighbor_prev);
-    set_next_ptr(new_free, neighbor_next);
-    set_prev_ptr(neighbor_next, new_free);
-    set_next_ptr(neighbor_prev, new_free);
-    
-    upd_last_free_block(neighbor, new_free);
+size_t node_key(void *block_ptr) {
+    return (fit_policy == FIT_ADDRESS) ? (size_t)(uintptr_t)block_ptr : get_block_size(block_ptr);
 }
 ​
-/* Function: right_search
- * ___________________
+/* Functions: splay
+ * __________________
  * Parameters:
- *    - r_neighbor: pointer to right neighbor (for expanding realloc request)
- *    - add_size: the additional size to be added in realloc request
+ *    - root: root of a size tree or an address tree (may be NULL)
+ *    - key: size (or address) to search for, compared against node_key
  *
- * Return: number of right neighboring blocks to be used for in-place realloc, 0 if not enough space for in-place realloc
+ * Return: new root of the tree, which is the node with that key if there is one and otherwise the node with the
+ *         closest smaller or larger key
  *
- * Description: This function checks if there is enough space for in-place realloc, looping through right neighboring blocks.
- *              If an allocated block is appears before the size requirement has been filled, the function returns 0. Otherwise,
- *              the function returns the number of neighboring blocks to use for the realloc request.
+ * Description: This is a top-down splay: the search path is taken apart into a left tree (keys below key) and
+ *              a right tree (keys above key), rotating at each zig-zig step, and the two are reassembled 
+ *              under the last node reached. side stands in for the roots of the left and right trees while
+ *              they are being built.
  */
-int right_search(void *r_neighbor, size_t add_size) {
-    int block_count = 0;
-    size_t total_space = 0;
+void *splay(void *root, size_t key) {
+    if(root == NULL) {
+        return NULL;
+    }
+    tree_node side = {{0, NULL, NULL}, NULL, NULL};
+    void *side_block = (char *)&side + WIDTH;
+    void *left_max = side_block;
+    void *right_min = side_block;
+    void *curr = root;
     
-    while(total_space < add_size) {
-        if(check_alloc(r_neighbor)) {
-            return 0;
+    while(true) {
+        if(key < node_key(curr)) {
+            void *child = get_node(curr)->left;
+            if(child != NULL && key < node_key(child)) {
+                get_node(curr)->left = get_node(child)->right;
+                get_node(child)->right = curr;
+                curr = child;
+                child = get_node(curr)->left;
+            }
+            if(child == NULL) {
+                break;
+            }
+            get_node(right_min)->left = curr;
+            right_min = curr;
+            curr = child;
+        } else if(key > node_key(curr)) {
+            void *child = get_node(curr)->right;
+            if(child != NULL && key > node_key(child)) {
+                get_node(curr)->right = get_node(child)->left;
+                get_node(child)->left = curr;
+                curr = child;
+                child = get_node(curr)->right;
+            }
+            if(child == NULL) {
+                break;
+            }
+            get_node(left_max)->right = curr;
+            left_max = curr;
+            curr = child;
+        } else {
+            break;
         }
-        total_space += (get_block_size(r_neighbor) + WIDTH);
-        r_neighbor = get_next_block(r_neighbor);
-        block_count += 1;
     }
-    return block_count;
+    get_node(left_max)->right = get_node(curr)->left;
+    get_node(right_min)->left = get_node(curr)->right;
+    get_node(curr)->left = side.right;
+    get_node(curr)->right = side.left;
+    return curr;
 }
 ​
-/* Function: fix_neighbors
- * ___________________
+/* Functions: tree_insert
+ * __________________
  * Parameters:
- *    - neighbor: pointer to first right neighboring block (for in-place realloc)
- *    - new_size: pointer to size_t storing size of the to-be reallocated block
- *    - num_blocks: number of right neighboring blocks to include in in-place realloc
- *    - space_needed: remaining number of bytes to add to allocate as part of realloc request
+ *    - ar: arena the block belongs to
+ *    - block_ptr: pointer to start of free block (size already written into its header)
  *
  * Return: N/A
  *
- * Description: This function is called when in-place realloc is possible. It loops through the appropriate right neighboring
- *              blocks, rearranging pointers to maintain the free list (since the free right neighbors will be converted to 
- *              allocated). The final free block to be allocated has a special case. If the resulting fragment of that free 
- *              block is smaller than the size of a header (24 bytes), it is included as padding (thus the pointer to new_size 
- *              is dereferenced and the value updated). Otherwise, the resulting piece of the free block is left in the free list.
+ * Description: This function splays the block's size to the root. A block of the same size already in the tree
+ *              gets the new block chained right behind it, otherwise the new block becomes the root.
  */
-void fix_neighbors(void *neighbor, size_t *new_size, int num_blocks, size_t space_needed) {
-    for(int i = 1; i <= num_blocks; i++) {
-        if(i == num_blocks)  {
-            size_t remaining_space = get_block_size(neighbor) + WIDTH - space_needed;
-            if(remaining_space >= sizeof(header)) {
-                void *new_partial_fb = (char *)neighbor + space_needed;
-                size_t new_fb_size = get_block_size(neighbor) - space_needed;
-                create_partial_fb(neighbor, new_partial_fb, new_fb_size);
-                return;
-            } else {
-                *new_size += remaining_space;
-            }
-        }
-​
-        void *neighbor_prev = get_prev_free(neighbor);
-        set_next_ptr(neighbor_prev, get_next_free(neighbor));
-        set_prev_ptr(get_next_free(neighbor), get_prev_free(neighbor));
-​
-        upd_last_free_block(neighbor, neighbor_prev);
-        
-        space_needed -= (get_block_size(neighbor) + WIDTH);
-        neighbor = get_next_block(neighbor);
-        nblocks -= 1;
+void tree_insert(arena *ar, void *block_ptr) {
+    size_t size = get_block_size(block_ptr);
+    tree_node *node = get_node(block_ptr);
+    void *root = splay(ar->size_tree, size);
+    
+    set_prev_ptr(block_ptr, NULL);
+    set_next_ptr(block_ptr, NULL);
+    if(root == NULL) {
+        node->left = NULL;
+        node->right = NULL;
+    } else if(size == get_block_size(root)) {
+        set_prev_ptr(block_ptr, root);
+        set_next_ptr(block_ptr, get_next_free(root));
+        set_prev_ptr(get_next_free(root), block_ptr);
+        set_next_ptr(root, block_ptr);
+        ar->size_tree = root;
+        return;
+    } else if(size < get_block_size(root)) {
+        node->left = get_node(root)->left;
+        node->right = root;
+        get_node(root)->left = NULL;
+    } else {
+        node->right = get_node(root)->right;
+        node->left = root;
+        get_node(root)->right = NULL;
     }
+    ar->size_tree = block_ptr;
 }
 ​
-​
-//ALLOCATOR FUNCTIONS:
-//____________________
-​
-​
-/* Function: myinit
- * ___________________
+/* Functions: tree_remove
+ * __________________
  * Parameters:
- *    - heap_start: start of heap segment
- *    - heap_size: size of heap segment
+ *    - ar: arena the block belongs to
+ *    - block_ptr: pointer to start of free block in the size tree
  *
- * Return: true if segment available for use, false otherwise
+ * Return: N/A
  *
- * Description: This function initializes global variables for the rest of the program. This includes initializing the start of 
- *              the heap, the heap's size, the first block, the number of total blocks, and the number of allocated blocks.
+ * Description: A block further down a chain is simply unlinked. The first block of a chain is splayed to the root
+ *              and either handed its place to the next block of the chain or joined its subtrees, splaying the
+ *              largest node of the left subtree up so it has no right child.
  */
-bool myinit(void *heap_start, size_t heap_size) {
-    segment_start = heap_start;
-    segment_size = heap_size;
-    last_free_block = (char *)segment_start + WIDTH;
-    start_block = last_free_block;
-    create_hdr(segment_start, heap_size - WIDTH, NULL, NULL);
-    
-    nblocks = 1;
-    nused = 0;
-    return true;
+void tree_remove(arena *ar, void *block_ptr) {
+    size_t size = get_block_size(block_ptr);
+    tree_node *node = get_node(block_ptr);
+    void *prev = get_prev_free(block_ptr);
+    void *next = get_next_free(block_ptr);
+    
+    if(prev != NULL) {
+        set_next_ptr(prev, next);
+        set_prev_ptr(next, prev);
+        return;
+    }
+    splay(ar->size_tree, size);
+    if(next != NULL) {
+        get_node(next)->left = node->left;
+        get_node(next)->right = node->right;
+        set_prev_ptr(next, NULL);
+        ar->size_tree = next;
+    } else if(node->left == NULL) {
+        ar->size_tree = node->right;
+    } else {
+        void *top = splay(node->left, size);
+        get_node(top)->right = node->right;
+        ar->size_tree = top;
+    }
 }
 ​
-/* Function: mymalloc
- * ___________________
+/* Functions: addr_insert
+ * __________________
  * Parameters:
- *    - req_size: requested block size
+ *    - ar: arena the block belongs to
+ *    - cls: size class of the block (at least NUM_EXACT_CLASSES)
+ *    - block_ptr: pointer to start of free block
  *
  * Return: N/A
  *
- * Description: This function allocates a block on the heap (using first_fit search). If the search is successful, a few different
- *              cases are checked regarding the difference in size between the block to be used for allocation and the size of the
- *              request. If the difference is less than the size of a header (24 bytes including pointers), the entire block is
- *              allocated (extra space used as padding). Otherwise, part of the free block is allocated and a partial free block 
- *              is left in the free list.
+ * Description: This function splays the block's address in the class's address tree. The root that comes up is 
+ *              the block's closest neighbor in address order, so the block is linked into the sorted free list 
+ *              right after it (or right before it) and then becomes the new root, without walking the list.
  */
-void *mymalloc(size_t req_size) {
-    if(req_size <= 0) {
-        return NULL;
+void addr_insert(arena *ar, int cls, void *block_ptr) {
+    void **tree = &ar->addr_trees[cls - NUM_EXACT_CLASSES];
+    tree_node *node = get_node(block_ptr);
+    void *root = splay(*tree, (uintptr_t)block_ptr);
+    void *prev = NULL;
+    void *next = NULL;
+    
+    if(root == NULL) {
+        node->left = NULL;
+        node->right = NULL;
+    } else if(root < block_ptr) {
+        prev = root;
+        next = get_next_free(root);
+        node->left = root;
+        node->right = get_node(root)->right;
+        get_node(root)->right = NULL;
+    } else {
+        prev = get_prev_free(root);
+        next = root;
+        node->right = root;
+        node->left = get_node(root)->left;
+        get_node(root)->left = NULL;
     }
+    *tree = block_ptr;
     
-    void *alloc_block = NULL;
-    req_size = round_up(req_size);
-    if((alloc_block = first_fit(req_size)) != NULL) {
-        size_t size_diff = get_block_size(alloc_block) - req_size;
-        
-        if(size_diff < sizeof(header)) {
-            req_size = size_diff + req_size;
-            if(alloc_block == last_free_block) {
-                last_free_block = get_prev_free(last_free_block);
-                set_next_ptr(last_free_block, NULL);
-            } else {
-                set_prev_ptr(get_next_free(alloc_block), get_prev_free(alloc_block));
-                set_next_ptr(get_prev_free(alloc_block), get_next_free(alloc_block));
-            }
-        } else {
-            void *new_partial_fb = (char *)alloc_block + req_size + WIDTH;
-            create_partial_fb(alloc_block, new_partial_fb,  size_diff - WIDTH);
-            nblocks += 1;
-        }
-        
-        set_hdr_size(alloc_block, req_size);
-        set_hdr_status(alloc_block, ALLOC);
-        
-        nused += 1;
-        return alloc_block;
+    set_prev_ptr(block_ptr, prev);
+    set_next_ptr(block_ptr, next);
+    set_prev_ptr(next, block_ptr);
+    if(prev != NULL) {
+        set_next_ptr(prev, block_ptr);
+    } else {
+        ar->free_lists[cls] = block_ptr;
     }
-    return NULL;
 }
 ​
-/* Function: myfree
- * ___________________
+/* Functions: addr_remove
+ * __________________
  * Parameters:
- *    - ptr: pointer to block to be freed
+ *    - ar: arena the block belongs to
+ *    - cls: size class of the block
+ *    - block_ptr: pointer to start of free block in the class's address tree
  *
  * Return: N/A
  *
- * Description: This function first checks if the block to be freed has a free right neighbor. If so, coalesce is called.
- *              Otherwise, the allocated block is changed to a free block.
+ * Description: This function takes the block out of the address tree (its free list links are handled by
+ *              remove_free). The block is splayed to the root and its subtrees are joined under the highest 
+ *              address of the left subtree, which has no right child once splayed up.
  */
-void myfree(void *ptr) {
-    if(ptr != NULL) {
-        if(!check_alloc(get_next_block(ptr))) {
-            coalesce(ptr);
-            nblocks -= 1;
-        } else {
-            change_to_free(ptr);
-        }
-        nused -= 1;
+void addr_remove(arena *ar, int cls, void *block_ptr) {
+    void **tree = &ar->addr_trees[cls - NUM_EXACT_CLASSES];
+    tree_node *node = get_node(block_ptr);
+    splay(*tree, (uintptr_t)block_ptr);
+    if(node->left == NULL) {
+        *tree = node->right;
+    } else {
+        void *top = splay(node->left, (uintptr_t)block_ptr);
+        get_node(top)->right = node->right;
+        *tree = top;
     }
 }
 ​
-/* Function: myrealloc
- * ___________________
+/* Functions: side_insert
+ * __________________
  * Parameters:
- *    - old_ptr: pointer to original block (subject of realloc request)
- *    - new_size: size of realloc request
+ *    - ar: arena the block belongs to
+ *    - cls: size class whose list the block was just pushed onto
+ *    - block_ptr: the block
+ *
+ * Return: N/A
+ *
+ * Description: This function mirrors the block in its class's side_array, or marks the array as overflowed if it 
+ *              is full. Classes below NUM_EXACT_CLASSES hold a single size each and have no array.
+ */
+void side_insert(arena *ar, int cls, void *block_ptr) {
+    if(cls < NUM_EXACT_CLASSES) {
+        return;
+    }
+    side_array *side = &ar->sides[cls - NUM_EXACT_CLASSES];
+    if(side->count == SIDE_SLOTS) {
+        side->overflow = true;
+        return;
+    }
+    side->sizes[side->count] = get_block_size(block_ptr);
+    side->blocks[side->count] = block_ptr;
+    side->count += 1;
+}
+​
+/* Functions: side_remove
+ * __________________
+ * Parameters:
+ *    - ar: arena the block belongs to
+ *    - cls: size class whose list the block was just unlinked from
+ *    - block_ptr: the block
+ *    - emptied: true if the list is now empty
+ *
+ * Return: N/A
+ */
+void side_remove(arena *ar, int cls, void *block_ptr, bool emptied) {
+    if(cls < NUM_EXACT_CLASSES) {
+        return;
+    }
+    side_array *side = &ar->sides[cls - NUM_EXACT_CLASSES];
+    for(uint32_t i = 0; i < side->count; i++) {
+        if(side->blocks[i] == block_ptr) {
+            side->count -= 1;
+            side->sizes[i] = side->sizes[side->count];
+            side->blocks[i] = side->blocks[side->count];
+            break;
+        }
+    }
+    if(emptied) {
+        side->overflow = false;
+    }
+}
+​
+/* Functions: insert_free
+ * __________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - block_ptr: pointer to start of free block (size already written into its header)
+ *
+ * Return: N/A
+ *
+ * Description: This function pushes the block onto the front of the free list for its size class (or into the
+ *              size tree, see uses_tree, or into its place in address order, see uses_addr_order). Since every block
+ *              turns free through here, it also writes the block's footer, clears DECOMMITTED (a new or merged free
+ *              block may have pages that aren't zero; callers that know better set it again) and tells the right
+ *              neighbor that its left neighbor is now free. A block that ends at the top chunk's epilogue becomes the
+ *              arena's wilderness instead. If the old wilderness is still set (it was left behind in an older chunk
+ *              when grow_arena started a new one) it goes on the lists like any other free block.
+ */
+void insert_free(arena *ar, void *block_ptr) {
+    size_t size = get_block_size(block_ptr);
+    int cls = get_class(size);
+    void *head = ar->free_lists[cls];
+
+    if(size > min_size) {
+        *(size_t *)((char *)block_ptr + size - WIDTH) = size;
+    }
+    (*get_hdr(block_ptr)).block_size &= ~(size_t)DECOMMITTED;
+    set_prev_status(get_next_block(block_ptr), FREE, size);
+    if(get_next_block(block_ptr) == ar->top->segment_end) {
+        void *old = ar->wilderness;
+        ar->wilderness = block_ptr;
+        if(old != NULL) {
+            insert_free(ar, old);
+        }
+        return;
+    }
+    if(uses_tree(size)) {
+        tree_insert(ar, block_ptr);
+        return;
+    }
+
+    if(uses_addr_order(size)) {
+        addr_insert(ar, cls, block_ptr);
+    } else {
+        set_prev_ptr(block_ptr, NULL);
+        set_next_ptr(block_ptr, head);
+        set_prev_ptr(head, block_ptr);
+        ar->free_lists[cls] = block_ptr;
+    }
+    ar->class_map[cls >> 6] |= (1ULL << (cls & 63));
+    side_insert(ar, cls, block_ptr);
+}
+
+/* Functions: remove_free
+ * __________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - block_ptr: pointer to start of free block (size must still match the class it was inserted under)
+ *
+ * Return: N/A
+ *
+ * Description: This function unlinks the block from its size class's free list (and its side_array), clearing the 
+ *              class's bit in ar->class_map if the list is left empty (or takes it out of the size tree, see uses_tree). Removing
+ *              the wilderness just clears ar->wilderness.
+ */
+void remove_free(arena *ar, void *block_ptr) {
+    if(block_ptr == ar->wilderness) {
+        ar->wilderness = NULL;
+        return;
+    }
+    if(uses_tree(get_block_size(block_ptr))) {
+        tree_remove(ar, block_ptr);
+        return;
+    }
+    void *prev = get_prev_free(block_ptr);
+    void *next = get_next_free(block_ptr);
+    int cls = get_class(get_block_size(block_ptr));
+
+    set_prev_ptr(next, prev);
+    if(prev != NULL) {
+        set_next_ptr(prev, next);
+    } else {
+        ar->free_lists[cls] = next;
+        if(next == NULL) {
+            ar->class_map[cls >> 6] &= ~(1ULL << (cls & 63));
+        }
+    }
+    if(uses_addr_order(get_block_size(block_ptr))) {
+        addr_remove(ar, cls, block_ptr);
+    }
+    side_remove(ar, cls, block_ptr, ar->free_lists[cls] == NULL);
+}
+
+
+//LONG HELPER FUNCTIONS:
+//______________________
+​
+/* Function: first_fit
+ * ___________________
+ * Parameters:
+ *    - ar: arena to search
+ *    - req_size: requested block size
+ *
+ * Return: pointer to first free block able to satisfy the request OR NULL if no block found
+ *
+ * Description: This function first searches the request's own size class, since blocks in that class may be 
+ *              smaller than the request. For the multi-size classes that means scanning the class's side_array: 
+ *              the compare loop has no branches, so the compiler can vectorize it, and the header of the chosen 
+ *              block is prefetched so carving it overlaps with the rest of the search. The list itself is only 
+ *              walked when the array has overflowed and holds no fit (prefetching each next block's header one
+ *              hop ahead). With FIT_ADDRESS the lowest-addressed fit is taken, so an overflowed array always falls back 
+ *              on the sorted list. Every block in a higher class is big enough, so if that fails the head of the next 
+ *              non-empty class is returned. If no free block big enough for the request is found, NULL is returned.
+ */
+void *first_fit(arena *ar, size_t req_size) {
+    int cls = get_class(req_size);
+    ar->searches += 1;
+    bool walk = true;
+    if(cls >= NUM_EXACT_CLASSES) {
+        side_array *side = &ar->sides[cls - NUM_EXACT_CLASSES];
+        unsigned fits = 0;
+        for(uint32_t i = 0; i < SIDE_SLOTS; i++) {
+            fits |= (unsigned)(i < side->count && side->sizes[i] >= req_size) << i;
+        }
+        if(fits != 0 && !(fit_policy == FIT_ADDRESS && side->overflow)) {
+            uint32_t pick = __builtin_ctz(fits);
+            for(uint32_t i = pick + 1; fit_policy == FIT_ADDRESS && i < side->count; i++) {
+                if(((fits >> i) & 0x1) && side->blocks[i] < side->blocks[pick]) {
+                    pick = i;
+                }
+            }
+            void *block = side->blocks[pick];
+            __builtin_prefetch(get_hdr(block), 1);
+            ar->probes += 1;
+            return block;
+        }
+        walk = side->overflow;
+    }
+    for(void *curr_block = walk ? ar->free_lists[cls] : NULL; curr_block != NULL; ) {
+        void *next_block = get_next_free(curr_block);
+        if(next_block != NULL) {
+            __builtin_prefetch(get_hdr(next_block));
+        }
+        ar->probes += 1;
+        if(get_block_size(curr_block) >= req_size) {
+            return curr_block;
+        }
+        curr_block = next_block;
+    }
+    cls = next_nonempty_class(ar, cls + 1);
+    ar->probes += (cls >= 0);
+    return (cls >= 0) ? ar->free_lists[cls] : NULL;
+}
+​
+/* Function: best_fit
+ * ___________________
+ * Parameters:
+ *    - ar: arena to search (fit_policy is FIT_BEST)
+ *    - req_size: requested block size (already rounded)
+ *
+ * Return: pointer to the smallest free block able to satisfy the request OR NULL if no block found
+ *
+ * Description: Classes below TREE_MIN hold exactly one size each, so the first non-empty one at or above the 
+ *              request's class is the best fit among small blocks. Otherwise the request's size is splayed to 
+ *              the root of the size tree. If the root ends up smaller than the request, the smallest node of its
+ *              right subtree is splayed up and made the root instead. A chained block of the winning size is 
+ *              preferred over the node itself so that taking it doesn't reshape the tree. Either way the search
+ *              is counted as a single probe.
+ */
+void *best_fit(arena *ar, size_t req_size) {
+    ar->searches += 1;
+    ar->probes += 1;
+    if(req_size < TREE_MIN) {
+        int cls = next_nonempty_class(ar, get_class(req_size));
+        if(cls >= 0 && cls < NUM_EXACT_CLASSES) {
+            return ar->free_lists[cls];
+        }
+    }
+    
+    void *root = splay(ar->size_tree, req_size);
+    if(root != NULL && get_block_size(root) < req_size && get_node(root)->right != NULL) {
+        void *succ = splay(get_node(root)->right, req_size);
+        get_node(succ)->left = root;
+        get_node(root)->right = NULL;
+        root = succ;
+    }
+    ar->size_tree = root;
+    if(root == NULL || get_block_size(root) < req_size) {
+        return NULL;
+    }
+    return (get_next_free(root) != NULL) ? get_next_free(root) : root;
+}
+​
+/* Function: create_partial_fb
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - orig_block: pointer to start of free block about to be allocated
+ *    - new_fb:     pointer to start of remaining piece of free block (i.e. start of block + size request)
+ *    - fb_size:    size of remaining piece of free block
+ *
+ * Return: N/A
+ *
+ * Description: This function is called during alloc and realloc requests when a free block will not be fully allocated.
+ *              It takes the original free block off its free list and files the remaining "free block piece" under
+ *              the size class that matches its new size.
+ */
+void create_partial_fb(arena *ar, void *orig_block, void *new_fb, size_t fb_size) {
+    ar->splits += 1;
+    remove_free(ar, orig_block);
+    create_hdr(get_hdr(new_fb), fb_size);
+    insert_free(ar, new_fb);
+}
+​
+/* Function: change_to_free
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - new_free: pointer to block being freed
+ *
+ * Return: N/A
+ *
+ * Description: This function is used for free and shink realloc requests. It sets the status of the new block to free
+ *              and pushes it onto the free list for its size class (so its size must already be set).
+ */
+void change_to_free(arena *ar, void *new_free) {
+    set_hdr_status(new_free, FREE);
+    insert_free(ar, new_free);
+}
+​
+/* Function: change_to_alloc
+ * ___________________
+ * Parameters:
+ *    - new_alloc: pointer to block being handed out (already off the free list, final size already set)
+ *
+ * Return: N/A
+ *
+ * Description: This function is used for malloc and expand realloc requests. It sets the status of the block to 
+ *              allocated and clears the right neighbor's PREV_FREE bit.
+ */
+void change_to_alloc(void *new_alloc) {
+    set_hdr_status(new_alloc, ALLOC);
+    set_prev_status(get_next_block(new_alloc), ALLOC, 0);
+}
+​
+/* Function: coalesce
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - new_free: pointer to block being freed (not on any free list)
+ *
+ * Return: pointer to the start of the merged block
+ *
+ * Description: This function merges the block being freed with its right neighbor and its left neighbor (found 
+ *              through the left neighbor's footer), whichever of the two are free. Each neighbor is taken off its
+ *              free list, so the caller gets back a single block that still has to be put on a free list with
+ *              change_to_free. Both checks are O(1).
+ */
+void *coalesce(arena *ar, void *new_free) {
+    size_t size = get_block_size(new_free);
+    void *neighbor = get_next_block(new_free);
+    
+    if(!check_alloc(neighbor)) {
+        remove_free(ar, neighbor);
+        size += get_block_size(neighbor) + WIDTH;
+        ar->nblocks -= 1;
+        ar->merges += 1;
+        ar->coalesces += 1;
+    }
+    if(check_prev_free(new_free)) {
+        new_free = get_prev_block(new_free);
+        remove_free(ar, new_free);
+        size += get_block_size(new_free) + WIDTH;
+        ar->nblocks -= 1;
+        ar->merges += 1;
+        ar->coalesces += 1;
+    }
+    set_hdr_size(new_free, size);
+    return new_free;
+}
+​
+/* Function: right_search
+ * ___________________
+ * Parameters:
+ *    - r_neighbor: pointer to right neighbor (for expanding realloc request)
+ *    - add_size: the additional size to be added in realloc request
+ *
+ * Return: number of right neighboring blocks to be used for in-place realloc, 0 if not enough space for in-place realloc
+ *
+ * Description: This function checks if there is enough space for in-place realloc, looping through right neighboring blocks.
+ *              If an allocated block is appears before the size requirement has been filled, the function returns 0. Otherwise,
+ *              the function returns the number of neighboring blocks to use for the realloc request.
+ */
+int right_search(void *r_neighbor, size_t add_size) {
+    int block_count = 0;
+    size_t total_space = 0;
+    
+    while(total_space < add_size) {
+        if(check_alloc(r_neighbor)) {
+            return 0;
+        }
+        total_space += (get_block_size(r_neighbor) + WIDTH);
+        r_neighbor = get_next_block(r_neighbor);
+        block_count += 1;
+    }
+    return block_count;
+}
+​
+/* Function: fix_neighbors
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - neighbor: pointer to first right neighboring block (for in-place realloc)
+ *    - new_size: pointer to size_t storing size of the to-be reallocated block
+ *    - num_blocks: number of right neighboring blocks to include in in-place realloc
+ *    - space_needed: remaining number of bytes to add to allocate as part of realloc request
+ *
+ * Return: N/A
+ *
+ * Description: This function is called when in-place realloc is possible. It loops through the appropriate right neighboring
+ *              blocks, taking each one off its free list (since the free right neighbors will be converted to 
+ *              allocated). The final free block to be allocated has a special case. If the resulting fragment of that free 
+ *              block is smaller than min_block (24 bytes, 16 with compact links), it is included as padding (thus the
+ *              pointer to new_size is dereferenced and the value updated). Otherwise, the resulting piece of the free
+ *              block is left in the free list.
+ */
+void fix_neighbors(arena *ar, void *neighbor, size_t *new_size, int num_blocks, size_t space_needed) {
+    for(int i = 1; i <= num_blocks; i++) {
+        if(i == num_blocks)  {
+            size_t remaining_space = get_block_size(neighbor) + WIDTH - space_needed;
+            if(remaining_space >= min_block) {
+                void *new_partial_fb = (char *)neighbor + space_needed;
+                size_t new_fb_size = get_block_size(neighbor) - space_needed;
+                create_partial_fb(ar, neighbor, new_partial_fb, new_fb_size);
+                ar->merges += 1;
+                return;
+            } else {
+                *new_size += remaining_space;
+            }
+        }
+​
+        remove_free(ar, neighbor);
+        
+        space_needed -= (get_block_size(neighbor) + WIDTH);
+        neighbor = get_next_block(neighbor);
+        ar->nblocks -= 1;
+        ar->merges += 1;
+    }
+}
+​
+​
+/* Function: grow_reserve
+ * ___________________
+ * Parameters:
+ *    - size: rounded size a block is being grown to
+ *
+ * Return: size to actually reserve for the block
+ *
+ * Description: Blocks of at least REALLOC_GROWTH_MIN bytes get half their new size again as headroom, so a buffer
+ *              that keeps growing by small steps is extended or moved O(log n) times instead of on every call. 
+ *              Smaller blocks, and reserves that would reach mmap_threshold (where mremap makes growth cheap 
+ *              anyway), get exactly the size asked for.
+ */
+size_t grow_reserve(size_t size) {
+    if(size < REALLOC_GROWTH_MIN || size > SIZE_MAX / 4) {
+        return size;
+    }
+    size_t reserve = round_up(size + size / 2);
+    if(mmap_threshold != 0 && reserve >= mmap_threshold) {
+        return size;
+    }
+    return reserve;
+}
+​
+/* Function: extend_right
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to
+ *    - block_ptr: allocated block being expanded
+ *    - new_size: rounded size the block should grow to (bigger than its current size)
+ *
+ * Return: true if the free blocks to the right had room and the block now spans at least new_size bytes
+ *
+ * Description: This function looks for enough contiguous free right neighbors with right_search and absorbs them
+ *              with fix_neighbors, splitting the space past new_size back off when it's big enough to be a block.
+ */
+bool extend_right(arena *ar, void *block_ptr, size_t new_size) {
+    size_t size_diff = new_size - get_block_size(block_ptr);
+    int r_free_blocks = right_search(get_next_block(block_ptr), size_diff);
+    if(!r_free_blocks) {
+        return false;
+    }
+    fix_neighbors(ar, get_next_block(block_ptr), &new_size, r_free_blocks, size_diff);
+    set_hdr_size(block_ptr, new_size);
+    change_to_alloc(block_ptr);
+    return true;
+}
+​
+/* Function: at_top
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to
+ *    - block_ptr: allocated block
+ *
+ * Return: true if nothing but (at most) one free block separates the block from the epilogue of the arena's top 
+ *         chunk, the only place grow_arena can extend a chunk in place
+ */
+bool at_top(arena *ar, void *block_ptr) {
+    void *next = get_next_block(block_ptr);
+    if(!check_alloc(next)) {
+        next = get_next_block(next);
+    }
+    return next == ar->top->segment_end;
+}
+​
+/* Function: left_extend
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - old_ptr: pointer to block being expanded by a realloc request
+ *    - new_size: requested (rounded) size of the block
+ *
+ * Return: pointer to the moved block, NULL if the free neighbors on both sides together still aren't big enough
+ *
+ * Description: This function is called when right_search alone can't satisfy an expansion. If the left neighbor is
+ *              free and the left neighbor, the block and its free right neighbor add up to new_size, all three are
+ *              merged and the payload is slid left with memmove. That is still cheaper than a relocate, which has
+ *              to find another free block before copying. Leftover space of at least a header goes back to the 
+ *              free lists.
+ */
+void *left_extend(arena *ar, void *old_ptr, size_t new_size) {
+    if(!check_prev_free(old_ptr)) {
+        return NULL;
+    }
+    void *left = get_prev_block(old_ptr);
+    void *right = get_next_block(old_ptr);
+    size_t curr_size = get_block_size(old_ptr);
+    size_t total_size = get_block_size(left) + WIDTH + curr_size;
+    if(!check_alloc(right)) {
+        total_size += get_block_size(right) + WIDTH;
+    }
+    if(total_size < new_size) {
+        return NULL;
+    }
+    
+    remove_free(ar, left);
+    ar->nblocks -= 1;
+    ar->merges += 1;
+    if(!check_alloc(right)) {
+        remove_free(ar, right);
+        ar->nblocks -= 1;
+        ar->merges += 1;
+    }
+    memmove(left, old_ptr, curr_size);
+    
+    size_t size_diff = total_size - new_size;
+    if(size_diff >= min_block) {
+        void *new_fb = (char *)left + new_size + WIDTH;
+        create_hdr(get_hdr(new_fb), size_diff - WIDTH);
+        change_to_free(ar, new_fb);
+        ar->nblocks += 1;
+        ar->splits += 1;
+    } else {
+        new_size = total_size;
+    }
+    set_hdr_size(left, new_size);
+    change_to_alloc(left);
+    return left;
+}
+​
+​
+//SHARED HEAP FUNCTIONS:
+//_______________________
+​
+/* Function: consolidate
+ * ___________________
+ * Parameters:
+ *    - ar: arena whose quick lists are emptied (caller holds its lock)
+ *
+ * Return: N/A
+ *
+ * Description: This function is the deferred merge pass. Every block waiting on a quick list is freed for real, 
+ *              coalescing with its neighbors and landing on the free lists.
+ */
+void consolidate(arena *ar) {
+    for(int bin = 0; bin < QUICK_BINS; bin++) {
+        while(ar->quick[bin] != NULL) {
+            void *block = ar->quick[bin];
+            ar->quick[bin] = *(void **)block;
+            change_to_free(ar, coalesce(ar, block));
+            ar->nused -= 1;
+        }
+    }
+    ar->nquick = 0;
+}
+​
+/* Function: find_fit
+ * ___________________
+ * Parameters:
+ *    - ar: arena to search
+ *    - req_size: rounded block size
+ *
+ * Return: free block of at least req_size bytes, NULL if there is none
+ *
+ * Description: This function picks a block from the free lists with the arena's fit_policy, falling back on the 
+ *              wilderness only when that fails. If the wilderness is too small as well and blocks are waiting on 
+ *              the quick lists, they are consolidated and the search runs once more.
+ */
+void *find_fit(arena *ar, size_t req_size) {
+    for(int pass = 0; pass < 2; pass++) {
+        void *block = (fit_policy == FIT_BEST) ? best_fit(ar, req_size) : first_fit(ar, req_size);
+        if(block != NULL) {
+            return block;
+        }
+        if(ar->wilderness != NULL && get_block_size(ar->wilderness) >= req_size) {
+            return ar->wilderness;
+        }
+        if(ar->nquick == 0) {
+            break;
+        }
+        consolidate(ar);
+    }
+    return NULL;
+}
+​
+/* Function: carve_block
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to
+ *    - alloc_block: free block on a free list, at least req_size bytes
+ *    - req_size: rounded request size
+ *
+ * Return: alloc_block, now allocated
+ *
+ * Description: A few different cases are checked regarding the difference in size between the block to be used for 
+ *              allocation and the size of the request. If the difference is less than min_block (24 bytes, 16 with 
+ *              compact links), the entire block is allocated (extra space used as padding). Otherwise, part of the 
+ *              free block is allocated and a partial free block is left in the free list. The leftover keeps a 
+ *              DECOMMITTED mark, since its trim_range lies inside the original block's and the split only writes
+ *              metadata outside it.
+ */
+void *carve_block(arena *ar, void *alloc_block, size_t req_size) {
+    size_t size_diff = get_block_size(alloc_block) - req_size;
+    size_t zeroed = (*get_hdr(alloc_block)).block_size & DECOMMITTED;
+    
+    if(size_diff < min_block) {
+        req_size = size_diff + req_size;
+        remove_free(ar, alloc_block);
+    } else {
+        void *new_partial_fb = (char *)alloc_block + req_size + WIDTH;
+        create_partial_fb(ar, alloc_block, new_partial_fb,  size_diff - WIDTH);
+        (*get_hdr(new_partial_fb)).block_size |= zeroed;
+        ar->nblocks += 1;
+    }
+    
+    (*get_hdr(alloc_block)).block_size &= ~(size_t)DECOMMITTED;
+    set_hdr_size(alloc_block, req_size);
+    change_to_alloc(alloc_block);
+    
+    ar->nused += 1;
+    return alloc_block;
+}
+​
+/* Function: heap_malloc
+ * ___________________
+ * Parameters:
+ *    - ar: arena to allocate from
+ *    - req_size: requested block size
+ *
+ * Return: pointer to newly allocated block, NULL if no free block is big enough
+ *
+ * Description: This function allocates a block in the arena (using first_fit or best_fit search), caller holds the
+ *              arena's lock. A block of exactly the rounded size waiting on a quick list is handed back as it is. 
+ *              Otherwise, if the search is successful, carve_block splits off whatever the request doesn't need.
+ */
+void *heap_malloc(arena *ar, size_t req_size) {
+    if(req_size <= 0) {
+        return NULL;
+    }
+    
+    void *alloc_block = NULL;
+    req_size = round_up(req_size);
+    if(req_size <= QUICK_MAX && ar->quick[get_quick_bin(req_size)] != NULL) {
+        alloc_block = ar->quick[get_quick_bin(req_size)];
+        ar->quick[get_quick_bin(req_size)] = *(void **)alloc_block;
+        ar->nquick -= 1;
+        return alloc_block;
+    }
+    alloc_block = find_fit(ar, req_size);
+    if(alloc_block != NULL) {
+        return carve_block(ar, alloc_block, req_size);
+    }
+    return NULL;
+}
+​
+/* Function: heap_calloc
+ * ___________________
+ * Parameters:
+ *    - ar: arena to allocate from (caller holds its lock)
+ *    - req_size: rounded request size
+ *
+ * Return: pointer to a newly allocated block whose first req_size bytes are zero, NULL if no free block is big 
+ *         enough
+ *
+ * Description: This function allocates like heap_malloc and then clears the block. When it was cut from a 
+ *              DECOMMITTED free block, the part of that block's trim_range it covers is already zero (and usually
+ *              not even resident), so only the bytes around it are cleared. A quick list hit is cleared in full.
+ */
+void *heap_calloc(arena *ar, size_t req_size) {
+    char *zero_start = NULL;
+    char *zero_end = NULL;
+    void *block;
+    if(req_size <= QUICK_MAX && ar->quick[get_quick_bin(req_size)] != NULL) {
+        block = heap_malloc(ar, req_size);
+    } else {
+        if((block = find_fit(ar, req_size)) == NULL) {
+            return NULL;
+        }
+        if((*get_hdr(block)).block_size & DECOMMITTED) {
+            trim_range(block, &zero_start, &zero_end);
+        }
+        block = carve_block(ar, block, req_size);
+    }
+    
+    char *end = (char *)block + req_size;
+    if(zero_end <= (char *)block || zero_start >= end) {
+        clear_range(block, end);
+    } else {
+        clear_range(block, zero_start);
+        clear_range(zero_end, end);
+    }
+    return block;
+}
+​
+/* Function: heap_aligned
+ * ___________________
+ * Parameters:
+ *    - ar: arena to allocate from (caller holds its lock)
+ *    - align: required payload alignment (power of two, greater than block_align)
+ *    - req_size: requested block size
+ *
+ * Return: pointer to newly allocated block whose address is a multiple of align, NULL if no free block is big enough
+ *
+ * Description: The first aligned address in a block is less than align + min_block bytes past its start (the gap
+ *              before it has to be 0 or at least min_block to become a block of its own), so searching for a 
+ *              block that much bigger than the request always finds one that fits. The gap is split off and put 
+ *              back on the free lists, and carve_block trims the aligned part down to the request like any other
+ *              allocation, so only the rounding up to add search headroom is ever wasted.
+ */
+void *heap_aligned(arena *ar, size_t align, size_t req_size) {
+    req_size = round_up(req_size);
+    size_t search_size = req_size + align + min_block;
+    void *block = find_fit(ar, search_size);
+    if(block == NULL) {
+        return NULL;
+    }
+    
+    char *aligned = (char *)(((uintptr_t)block + align - 1) & ~(uintptr_t)(align - 1));
+    while(aligned != block && (size_t)(aligned - (char *)block) < min_block) {
+        aligned += align;
+    }
+    if(aligned != block) {
+        size_t gap = aligned - (char *)block;
+        size_t total = get_block_size(block);
+        remove_free(ar, block);
+        create_hdr(get_hdr(aligned), total - gap);
+        set_hdr_size(block, gap - WIDTH);
+        insert_free(ar, block);
+        insert_free(ar, aligned);
+        ar->nblocks += 1;
+        ar->splits += 1;
+    }
+    return carve_block(ar, aligned, req_size);
+}
+​
+/* Function: carve_run
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to
+ *    - block: free block on a free list with room for count blocks of size bytes back to back
+ *    - size: rounded size of each block
+ *    - count: number of blocks to carve
+ *    - out: where the new blocks are stored
+ *
+ * Return: N/A
+ *
+ * Description: This function takes the block off its free list once and writes count allocated headers into it 
+ *              one after another. Whatever is left past the last block becomes a free block if it's at least 
+ *              min_block and is absorbed into the last block otherwise.
+ */
+void carve_run(arena *ar, void *block, size_t size, size_t count, void **out) {
+    size_t leftover = get_block_size(block) - (count * (size + WIDTH) - WIDTH);
+    char *curr = block;
+    remove_free(ar, block);
+    set_hdr_size(block, size);
+    for(size_t i = 0; i < count; i++) {
+        if(i > 0) {
+            create_hdr(get_hdr(curr), size);
+        }
+        set_hdr_status(curr, ALLOC);
+        out[i] = curr;
+        curr += size + WIDTH;
+    }
+    
+    if(leftover >= min_block) {
+        create_hdr(get_hdr(curr), leftover - WIDTH);
+        insert_free(ar, curr);
+        ar->nblocks += count;
+        ar->splits += 1;
+    } else {
+        set_hdr_size(out[count - 1], size + leftover);
+        set_prev_status(get_next_block(out[count - 1]), ALLOC, 0);
+        ar->nblocks += count - 1;
+    }
+    ar->nused += count;
+}
+​
+/* Function: heap_malloc_batch
+ * ___________________
+ * Parameters:
+ *    - ar: arena to allocate from (caller holds its lock)
+ *    - size: rounded size of each block
+ *    - count: number of blocks wanted
+ *    - out: where the new blocks are stored
+ *
+ * Return: number of blocks allocated (less than count once the arena has no free block left for even one)
+ *
+ * Description: This function searches once for a free block that can hold the whole run and carves it with 
+ *              carve_run. When no block is that big, the run is halved until one fits, and the search starts over
+ *              for whatever is still missing.
+ */
+size_t heap_malloc_batch(arena *ar, size_t size, size_t count, void **out) {
+    size_t done = 0;
+    size_t run = count;
+    while(done < count && run > 0) {
+        run = (run < count - done) ? run : count - done;
+        void *block = (run < SIZE_MAX / (size + WIDTH)) ? find_fit(ar, run * (size + WIDTH) - WIDTH) : NULL;
+        if(block == NULL) {
+            run /= 2;
+            continue;
+        }
+        carve_run(ar, block, size, run, out + done);
+        done += run;
+    }
+    return done;
+}
+​
+/* Function: heap_free
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - ptr: pointer to block to be freed
+ *
+ * Return: N/A
+ *
+ * Description: Caller holds the arena's lock. This function merges the block to be freed with whichever of its
+ *              neighbors are free (coalesce) and puts the resulting block on the free list for its size class. With
+ *              defer_coalesce, blocks of up to QUICK_MAX bytes are pushed onto their quick list as they are instead
+ *              (still marked allocated, so neither coalesce nor right_search touches them), and the lists are
+ *              consolidated once they hold more than QUICK_LIMIT blocks.
+ */
+void heap_free(arena *ar, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    size_t size = get_block_size(ptr);
+    if(defer_coalesce && size <= QUICK_MAX) {
+        *(void **)ptr = ar->quick[get_quick_bin(size)];
+        ar->quick[get_quick_bin(size)] = ptr;
+        if(++ar->nquick > QUICK_LIMIT) {
+            consolidate(ar);
+        }
+        return;
+    }
+    change_to_free(ar, coalesce(ar, ptr));
+    ar->nused -= 1;
+}
+​
+/* Function: heap_free_run
+ * ___________________
+ * Parameters:
+ *    - ar: arena the blocks belong to (caller holds its lock)
+ *    - blocks: allocated blocks that sit right next to each other, in address order
+ *    - count: number of blocks
+ *
+ * Return: N/A
+ *
+ * Description: This function turns the run into one block by rewriting the first header's size, then coalesces 
+ *              that block with its outer neighbors and files it on a free list, so the whole run costs a single 
+ *              coalesce and a single insert.
+ */
+void heap_free_run(arena *ar, void **blocks, size_t count) {
+    void *last = blocks[count - 1];
+    size_t size = (size_t)((char *)last - (char *)blocks[0]) + get_block_size(last);
+    set_hdr_size(blocks[0], size);
+    ar->nblocks -= count - 1;
+    ar->merges += 1;
+    ar->nused -= count;
+    change_to_free(ar, coalesce(ar, blocks[0]));
+}
+​
+/* Function: heap_realloc
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block(s) belong to
+ *    - old_ptr: pointer to original block (subject of realloc request, not NULL)
+ *    - new_size: size of realloc request (not 0)
+ *
+ * Return: pointer to the reallocated block, NULL if its right neighbors can't hold new_size (old_ptr is left untouched)
+ *
+ * Description: Caller holds the arena's lock. This function fulfills reallocation requests in place. If the request
+ *              will shrink the block, there are two cases. The implicit case is that the difference in size between the
+ *              reallocated block and original block is less than the size of min_block (24 bytes, 16 with compact
+ *              links), or, for blocks of at least REALLOC_GROWTH_MIN bytes, no more than the headroom grow_reserve
+ *              would have given them. In this case, nothing changes, as the remaining space is treated as padding.
+ *              Otherwise the remaining space is added as a block to the free list. For expand requests, extend_right
+ *              first tries to absorb the free right neighbors for the size plus grow_reserve's headroom and then for
+ *              the exact size. If neither fits, NULL is returned and resize_block moves on to growing the arena
+ *              (top_extend), sliding left (left_extend) and finally moving the block.
+ */
+void *heap_realloc(arena *ar, void *old_ptr, size_t new_size) {
+    size_t curr_size = get_block_size(old_ptr);
+    new_size = round_up(new_size);
+​
+    if(curr_size >= new_size) { //SHRINK
+        size_t size_diff = curr_size - new_size;
+        size_t headroom = (new_size >= REALLOC_GROWTH_MIN) ? grow_reserve(new_size) - new_size : 0;
+        
+        if (size_diff >= min_block && size_diff > headroom) {
+            void *new_free_start = (char *)old_ptr + new_size + WIDTH;
+            set_hdr_size(old_ptr, new_size);
+            create_hdr(get_hdr(new_free_start), size_diff - WIDTH);
+            change_to_free(ar, coalesce(ar, new_free_start));
+            ar->nblocks += 1;
+            ar->splits += 1;
+        }
+        return old_ptr;
+        
+    } else { //EXPAND
+        size_t reserve = grow_reserve(new_size);
+        if((reserve > new_size && extend_right(ar, old_ptr, reserve)) || extend_right(ar, old_ptr, new_size)) {
+            return old_ptr;
+        }
+        return NULL;
+    }
+}
+​
+​
+//NUMA NODES:
+//____________
+​
+/* Function: read_sys_file
+ * ___________________
+ * Parameters:
+ *    - path: sysfs file to read
+ *    - buf / len: buffer for its contents (NUL-terminated)
+ *
+ * Return: true if anything was read
+ *
+ * Description: This function uses plain open and read rather than stdio, since myinit_config can run inside the
+ *              first malloc of a preloaded program and stdio would allocate.
+ */
+bool read_sys_file(const char *path, char *buf, size_t len) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    ssize_t n = read(fd, buf, len - 1);
+    close(fd);
+    buf[(n > 0) ? n : 0] = '\0';
+    return n > 0;
+}
+​
+/* Function: load_numa_topology
+ * ___________________
+ * Return: number of NUMA nodes (1 if the system doesn't report any)
+ *
+ * Description: This function reads the online node list and each node's CPU list (both in sysfs "0-3,8" range 
+ *              syntax) and fills in cpu_node. Nodes past MAX_NODES and CPUs past MAX_CPUS are ignored.
+ */
+size_t load_numa_topology(void) {
+    char buf[4096];
+    memset(cpu_node, 0, sizeof(cpu_node));
+    if(!read_sys_file("/sys/devices/system/node/online", buf, sizeof(buf))) {
+        return 1;
+    }
+    size_t nodes = 0;
+    for(char *c = buf; *c != '\0'; ) {
+        size_t last = strtoul(c, &c, 10);
+        nodes = (last + 1 > nodes) ? last + 1 : nodes;
+        c += (*c != '\0');
+    }
+    nodes = (nodes == 0) ? 1 : (nodes > MAX_NODES) ? MAX_NODES : nodes;
+    
+    for(size_t node = 0; node < nodes; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist", node);
+        if(!read_sys_file(path, buf, sizeof(buf))) {
+            continue;
+        }
+        for(char *c = buf; *c >= '0' && *c <= '9'; ) {
+            size_t first = strtoul(c, &c, 10);
+            size_t last = (*c == '-') ? strtoul(c + 1, &c, 10) : first;
+            for(size_t cpu = first; cpu <= last && cpu < MAX_CPUS; cpu++) {
+                cpu_node[cpu] = node;
+            }
+            c += (*c == ',');
+        }
+    }
+    return nodes;
+}
+​
+/* Function: bind_to_node
+ * ___________________
+ * Parameters:
+ *    - start / len: memory to bind (only the whole pages inside it are affected)
+ *    - node: NUMA node its pages should come from
+ *
+ * Return: N/A
+ *
+ * Description: This function sets an MPOL_PREFERRED policy on the range with the mbind system call (no libnuma 
+ *              needed), so pages faulted in later come from node while it has memory and from elsewhere once it 
+ *              doesn't. Pages that are already resident stay where they are.
+ */
+void bind_to_node(void *start, size_t len, int node) {
+    uintptr_t first = ((uintptr_t)start + page_size - 1) & ~(uintptr_t)(page_size - 1);
+    uintptr_t last = ((uintptr_t)start + len) & ~(uintptr_t)(page_size - 1);
+    unsigned long mask = 1UL << node;
+    if(last > first) {
+        syscall(SYS_mbind, first, last - first, MPOL_PREFERRED, &mask, MAX_NODES + 1, 0);
+    }
+}
+​
+/* Function: current_node
+ * ___________________
+ * Return: NUMA node of the CPU the calling thread is running on (modulo numa_nodes)
+ */
+size_t current_node(void) {
+    int cpu = sched_getcpu();
+    return cpu_node[((cpu > 0) ? cpu : 0) % MAX_CPUS] % numa_nodes;
+}
+​
+/* Function: node_arena
+ * ___________________
+ * Parameters:
+ *    - node: NUMA node (less than numa_nodes)
+ *    - slot: any number, used to pick among the node's arenas
+ *
+ * Return: one of the arenas placed on node
+ */
+arena *node_arena(size_t node, size_t slot) {
+    size_t per_node = (narenas - node + numa_nodes - 1) / numa_nodes;
+    return &arenas[node + numa_nodes * (slot % per_node)];
+}
+​
+​
+//PER-THREAD CACHE AND ARENAS:
+//____________________________
+​
+/* Function: arena_of
+ * ___________________
+ * Parameters:
+ *    - block_ptr: pointer to start of block
+ *
+ * Return: pointer to the arena the block was carved from
+ *
+ * Description: Arenas are consecutive slices of the segment that are all arena_span bytes long (except the last,
+ *              which takes the remainder), so for blocks inside the segment the owner falls out of the block's offset.
+ *              Blocks in memory mapped by grow_arena are looked up in regions, which stays short because each
+ *              arena's mappings double in size.
+ */
+arena *arena_of(void *block_ptr) {
+    if(block_ptr >= heap_base && block_ptr < heap_end) {
+        size_t index = (size_t)((char *)block_ptr - (char *)heap_base) / arena_span;
+        return &arenas[(index < narenas) ? index : narenas - 1];
+    }
+    size_t count = __atomic_load_n(&nregions, __ATOMIC_ACQUIRE);
+    for(size_t i = 0; i < count; i++) {
+        if(block_ptr >= regions[i].start && block_ptr < regions[i].end) {
+            return regions[i].owner;
+        }
+    }
+    return NULL;
+}
+​
+/* Function: add_region
+ * ___________________
+ * Parameters:
+ *    - start: start of a range just mapped by grow_arena
+ *    - end: end of the range
+ *    - owner: arena the range belongs to
+ *
+ * Return: true if the range was recorded, false if regions is full
+ *
+ * Description: This function appends the range to regions and then publishes the new count, so unlocked readers in
+ *              arena_of only ever see entries that are completely written.
+ */
+bool add_region(void *start, void *end, arena *owner) {
+    pthread_mutex_lock(&region_lock);
+    size_t count = nregions;
+    if(count < MAX_REGIONS) {
+        regions[count].start = start;
+        regions[count].end = end;
+        regions[count].owner = owner;
+        __atomic_store_n(&nregions, count + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&region_lock);
+    return count < MAX_REGIONS;
+}
+​
+/* Function: map_chunk
+ * ___________________
+ * Parameters:
+ *    - hint: address right after the top chunk
+ *    - len: length of the mapping (a multiple of HUGE_PAGE_SIZE with huge_pages)
+ *
+ * Return: the new mapping, MAP_FAILED if there is no memory
+ *
+ * Description: The mapping is asked for at hint first, so grow_arena can extend the top chunk in place, and 
+ *              anywhere otherwise. With huge_pages, MAP_HUGETLB is tried before anything else (it only succeeds 
+ *              when the system has huge pages reserved). Failing that, a mapping that can't go at hint is placed 
+ *              on a HUGE_PAGE_SIZE boundary by mapping a huge page extra and unmapping the ends, and the result 
+ *              is marked MADV_HUGEPAGE so transparent huge pages can back it.
+ */
+void *map_chunk(void *hint, size_t len) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *map = MAP_FAILED;
+    if(huge_pages && MAP_HUGETLB != 0) {
+        map = mmap(hint, len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB | MAP_FIXED_NOREPLACE, -1, 0);
+        if(map == MAP_FAILED) {
+            map = mmap(NULL, len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        }
+        if(map != MAP_FAILED) {
+            return map;
+        }
+    }
+    
+    map = mmap(hint, len, PROT_READ | PROT_WRITE, flags | MAP_FIXED_NOREPLACE, -1, 0);
+    if(map == MAP_FAILED && huge_pages) {
+        char *raw = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if(raw != MAP_FAILED) {
+            char *aligned = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+            if(aligned != raw) {
+                munmap(raw, aligned - raw);
+            }
+            if(raw + HUGE_PAGE_SIZE != aligned) {
+                munmap(aligned + len, raw + HUGE_PAGE_SIZE - aligned);
+            }
+            map = aligned;
+        }
+    } else if(map == MAP_FAILED) {
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    }
+#ifdef MADV_HUGEPAGE
+    if(map != MAP_FAILED && huge_pages) {
+        madvise(map, len, MADV_HUGEPAGE);
+    }
+#endif
+    return map;
+}
+​
+/* Function: grow_arena
+ * ___________________
+ * Parameters:
+ *    - ar: arena that is out of memory (caller holds its lock)
+ *    - req_size: rounded size of the request that didn't fit
+ *
+ * Return: true if the arena now has a free block big enough for the request, false otherwise
+ *
+ * Description: This function maps at least grow_size more bytes (doubling grow_size for next time, up to 
+ *              MAX_GROW_SIZE, and rounding to whole huge pages with huge_pages). It first asks map_chunk for the 
+ *              range right after the top chunk: if the kernel places it 
+ *              there, the old epilogue becomes the header of a new free block that is coalesced with a free last 
+ *              block, and a new epilogue fence post goes at the new end. Otherwise the mapping becomes a new chunk 
+ *              with its own chunk struct, first block and epilogue, linked after the others. With compact_links, a
+ *              mapping that lands outside the COMPACT_SPAN window after heap_base can't be linked and is given back.
+ *              When arenas are placed by node, the mapping is bound to the arena's node. The new free block is marked
+ *              DECOMMITTED, as its pages are fresh from the kernel. When it merges with a DECOMMITTED free block, the
+ *              old block's last page (footer and epilogue) is cleared first so the merged block can keep the mark.
+ */
+bool grow_arena(arena *ar, size_t req_size) {
+    size_t len = req_size + sizeof(chunk) + 3 * WIDTH;
+    len = page_round((len > ar->grow_size) ? len : ar->grow_size);
+    if(huge_pages) {
+        len = (len + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    }
+    
+    void *hint = ar->top->segment_end;
+    void *map = map_chunk(hint, len);
+    if(map == MAP_FAILED) {
+        return false;
+    }
+    if(compact_links && (map < heap_base || (size_t)((char *)map - (char *)heap_base) + len > COMPACT_SPAN)) {
+        munmap(map, len);
+        return false;
+    }
+    if(!add_region(map, (char *)map + len, ar)) {
+        munmap(map, len);
+        return false;
+    }
+    if(numa_nodes != 0) {
+        bind_to_node(map, len, ar->node);
+    }
+    ar->grow_size = (ar->grow_size * 2 < MAX_GROW_SIZE) ? ar->grow_size * 2 : MAX_GROW_SIZE;
+    
+    void *new_fb;
+    if(map == hint) {
+        new_fb = hint;
+        set_hdr_size(new_fb, len - WIDTH);
+        ar->top->segment_end = (char *)hint + len;
+    } else {
+        chunk *ch = map;
+        ch->start_block = (char *)map + sizeof(chunk) + WIDTH;
+        ch->segment_end = (char *)map + len;
+        ch->next = NULL;
+        create_hdr(get_hdr(ch->start_block), len - sizeof(chunk) - 2 * WIDTH);
+        ar->top->next = ch;
+        ar->top = ch;
+        new_fb = ch->start_block;
+    }
+    (*get_hdr(ar->top->segment_end)).block_size = ALLOC;
+    ar->nblocks += 1;
+    
+    void *fresh = new_fb;
+    void *left = check_prev_free(new_fb) ? get_prev_block(new_fb) : NULL;
+    bool zeroed = left == NULL || ((*get_hdr(left)).block_size & DECOMMITTED);
+    char *old_last = (left != NULL) ? (char *)left + get_block_size(left) - WIDTH : NULL;
+    new_fb = coalesce(ar, new_fb);
+    change_to_free(ar, new_fb);
+    if(zeroed) {
+        char *start;
+        char *end;
+        if(left != NULL && trim_range(new_fb, &start, &end)) {
+            char *tail = (char *)((uintptr_t)old_last & ~(uintptr_t)(trim_granule - 1));
+            clear_range((tail > start) ? tail : start, fresh);
+        }
+        (*get_hdr(new_fb)).block_size |= DECOMMITTED;
+    }
+    return get_block_size(new_fb) >= req_size;
+}
+​
+/* Function: top_extend
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to (caller holds its lock)
+ *    - block_ptr: allocated block being expanded
+ *    - new_size: rounded size the block should grow to
+ *
+ * Return: block_ptr if the block now spans at least new_size bytes, NULL otherwise
+ *
+ * Description: When growth is enabled and the block sits at the top of the arena, this function has grow_arena map
+ *              more memory right after it and absorbs the new free space (with headroom from grow_reserve when the
+ *              mapping is big enough), so a growing buffer at the end of the heap never has to be copied. If the 
+ *              kernel puts the mapping somewhere else, the new chunk is simply left for later allocations.
+ */
+void *top_extend(arena *ar, void *block_ptr, size_t new_size) {
+    if(ar->grow_size == 0 || !at_top(ar, block_ptr)) {
+        return NULL;
+    }
+    size_t reserve = grow_reserve(new_size);
+    if(!grow_arena(ar, reserve - get_block_size(block_ptr))) {
+        return NULL;
+    }
+    if(extend_right(ar, block_ptr, reserve) || extend_right(ar, block_ptr, new_size)) {
+        return block_ptr;
+    }
+    return NULL;
+}
+​
+/* Function: unmap_regions
+ * ___________________
+ * Return: N/A
+ *
+ * Description: This function is called by myinit_config to give back everything grow_arena mapped for the previous
+ *              heap.
+ */
+void unmap_regions(void) {
+    for(size_t i = 0; i < nregions; i++) {
+        munmap(regions[i].start, (char *)regions[i].end - (char *)regions[i].start);
+    }
+    nregions = 0;
+}
+​
+/* Function: home_arena
+ * ___________________
+ * Parameters:
+ *    - tc: calling thread's tcache
+ *
+ * Return: arena the calling thread should allocate from
+ *
+ * Description: When arenas are placed by NUMA node, the arena is one on the node the thread is running on right
+ *              now, spread over that node's arenas by the round-robin arena the thread was handed in get_tcache. 
+ *              With ARENA_BY_CPU the arena follows the CPU the thread is running on right now (so a migrated 
+ *              thread moves with it). Otherwise it is the arena the thread was handed in get_tcache.
+ */
+arena *home_arena(tcache *tc) {
+    if(numa_nodes != 0) {
+        return node_arena(current_node(), tc->home - arenas);
+    }
+    if(arena_select == ARENA_BY_CPU) {
+        int cpu = sched_getcpu();
+        return &arenas[((cpu > 0) ? cpu : 0) % narenas];
+    }
+    return tc->home;
+}
+​
+/* Function: remote_push
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to
+ *    - block: allocated block freed by a thread whose home is another arena
+ *
+ * Return: N/A
+ *
+ * Description: This function pushes the block onto the arena's remote_frees stack with a single compare-and-swap
+ *              instead of taking the arena's lock. The block stays marked as allocated until remote_drain frees it.
+ *              Only remote_drain ever takes blocks off, and it takes the whole stack at once, so there is no ABA
+ *              problem to guard against.
+ */
+void remote_push(arena *ar, void *block) {
+    void *head = __atomic_load_n(&ar->remote_frees, __ATOMIC_RELAXED);
+    do {
+        *(void **)block = head;
+    } while(!__atomic_compare_exchange_n(&ar->remote_frees, &head, block, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+​
+/* Function: remote_drain
+ * ___________________
+ * Parameters:
+ *    - ar: arena whose lock the caller holds
+ *
+ * Return: N/A
+ *
+ * Description: This function detaches the arena's whole remote_frees stack with one exchange and frees every block
+ *              on it with heap_free (so they are coalesced like any other free). It is called from the allocation
+ *              slow paths once the lock is already held, which keeps foreign frees off the lock entirely.
+ */
+void remote_drain(arena *ar) {
+    if(__atomic_load_n(&ar->remote_frees, __ATOMIC_RELAXED) == NULL) {
+        return;
+    }
+    void *block = __atomic_exchange_n(&ar->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while(block != NULL) {
+        void *next = *(void **)block;
+        heap_free(ar, block);
+        block = next;
+    }
+}
+​
+/* Function: arena_free
+ * ___________________
+ * Parameters:
+ *    - tc: calling thread's tcache
+ *    - ptr: allocated arena block to be freed
+ *
+ * Return: N/A
+ *
+ * Description: This function frees a block in its own arena. If that isn't the calling thread's home arena the
+ *              block goes onto the arena's remote_frees stack for its owner to drain. Otherwise the block is freed
+ *              under the lock, along with anything other threads have pushed in the meantime.
+ */
+void arena_free(tcache *tc, void *ptr) {
+    arena *ar = arena_of(ptr);
+    if(ar != home_arena(tc)) {
+        remote_push(ar, ptr);
+        return;
+    }
+    lock_arena(ar);
+    remote_drain(ar);
+    heap_free(ar, ptr);
+    unlock_arena(ar);
+}
+​
+/* Function: arena_malloc
+ * ___________________
+ * Parameters:
+ *    - home: arena to try first
+ *    - size: rounded request size
+ *    - align: payload alignment for heap_aligned, 0 for a plain heap_malloc
+ *    - zero: allocate with heap_calloc instead (align must be 0)
+ *
+ * Return: pointer to newly allocated block, NULL if every arena is out of memory
+ *
+ * Description: This function allocates from the home arena under its lock, moving on to the other arenas in turn
+ *              only when the home arena can't fit the request. Each arena's remote frees are drained first. If none of
+ *              them can and growth is enabled, the home arena maps more memory with grow_arena (enough for
+ *              heap_aligned's padded search if needed).
+ */
+void *arena_malloc(arena *home, size_t size, size_t align, bool zero) {
+    arena *ar = home;
+    do {
+        lock_arena(ar);
+        remote_drain(ar);
+        void *block = (align != 0) ? heap_aligned(ar, align, size) : zero ? heap_calloc(ar, size) : heap_malloc(ar, size);
+        unlock_arena(ar);
+        if(block != NULL) {
+            return block;
+        }
+        ar = (ar + 1 == arenas + narenas) ? arenas : ar + 1;
+    } while(ar != home);
+    
+    if(home->grow_size == 0) {
+        return NULL;
+    }
+    lock_arena(home);
+    void *block = NULL;
+    if(grow_arena(home, (align != 0) ? size + align + min_block : size)) {
+        block = (align != 0) ? heap_aligned(home, align, size) : zero ? heap_calloc(home, size) : heap_malloc(home, size);
+    }
+    unlock_arena(home);
+    return block;
+}
+​
+/* Function: get_tcache_bin
+ * ___________________
+ * Parameters:
+ *    - size: block size (<= TCACHE_MAX)
+ *
+ * Return: index of the tcache bin holding blocks of exactly that size
+ */
+int get_tcache_bin(size_t size) {
+    return (size >> 3) - 1;
+}
+​
+/* Function: tcache_push
+ * ___________________
+ * Parameters:
+ *    - tc: thread cache
+ *    - block: allocated block to be cached
+ *    - size: size of the block (<= TCACHE_MAX)
+ *
+ * Return: N/A
+ *
+ * Description: This function pushes the block onto the bin for its exact size, linking it through its first payload
+ *              word. The block stays marked as allocated in its arena while it is cached.
+ */
+void tcache_push(tcache *tc, void *block, size_t size) {
+    int bin = get_tcache_bin(size);
+    *(void **)block = tc->bins[bin];
+    tc->bins[bin] = block;
+    tc->counts[bin] += 1;
+}
+​
+/* Function: tcache_drain
+ * ___________________
+ * Parameters:
+ *    - tc: thread cache
+ *    - bin: index of the bin to drain
+ *    - count: maximum number of blocks to return
+ *
+ * Return: N/A
+ *
+ * Description: This function returns up to count blocks from the bin to the arenas they came from. Blocks from the
+ *              home arena are freed under its lock, taken once for the whole drain. Blocks from other arenas are 
+ *              pushed onto their arena's remote_frees stack, so a thread freeing memory another thread allocated
+ *              never waits on that thread's lock.
+ */
+void tcache_drain(tcache *tc, int bin, int count) {
+    arena *home = home_arena(tc);
+    bool locked = false;
+    for(int i = 0; i < count && tc->bins[bin] != NULL; i++) {
+        void *block = tc->bins[bin];
+        arena *ar = arena_of(block);
+        tc->bins[bin] = *(void **)block;
+        tc->counts[bin] -= 1;
+        
+        if(ar != home) {
+            remote_push(ar, block);
+            continue;
+        }
+        if(!locked) {
+            lock_arena(home);
+            remote_drain(home);
+            locked = true;
+        }
+        heap_free(home, block);
+    }
+    if(locked) {
+        unlock_arena(home);
+    }
+}
+​
+/* Function: flush_tcache
+ * ___________________
+ * Parameters:
+ *    - arg: pointer to the exiting thread's tcache (registered with pthread_setspecific)
+ *
+ * Return: N/A
+ *
+ * Description: This function runs as the tcache_key destructor when a thread exits and hands every block still
+ *              sitting in the thread's cache back to its arena. A cache left over from before the last myinit
+ *              points into a heap that no longer exists, so it is dropped instead.
+ */
+void flush_tcache(void *arg) {
+    tcache *tc = arg;
+    if(tc->generation != heap_generation) {
+        return;
+    }
+    for(int bin = 0; bin < TCACHE_BINS; bin++) {
+        tcache_drain(tc, bin, TCACHE_COUNT);
+    }
+}
+​
+/* Function: create_tcache_key
+ * ___________________
+ * Return: N/A
+ *
+ * Description: This function is run once (through pthread_once) to create the key whose destructor flushes each 
+ *              thread's cache on exit.
+ */
+void create_tcache_key(void) {
+    pthread_key_create(&tcache_key, flush_tcache);
+}
+​
+/* Function: next_check
+ * ___________________
+ * Parameters:
+ *    - tc: thread cache
+ *
+ * Return: number of frees until the thread's next sampled check
+ *
+ * Description: The gap is drawn uniformly from 1 to 2 * check_interval - 1, so checks land on check_interval 
+ *              frees apart on average without following the period of the program's own free pattern.
+ */
+size_t next_check(tcache *tc) {
+    uint32_t x = tc->check_seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tc->check_seed = x;
+    return 1 + x % (2 * check_interval - 1);
+}
+​
+/* Function: get_tcache
+ * ___________________
+ * Return: pointer to the calling thread's tcache
+ *
+ * Description: This function returns the calling thread's cache, first emptying it if it was filled before the 
+ *              most recent myinit (those blocks belong to the old heap). A fresh cache is given the next arena in 
+ *              round-robin order as its home, and a seed (from its own address) for spacing out sampled checks.
+ */
+tcache *get_tcache(void) {
+    tcache *tc = &thread_cache;
+    if(tc->generation != heap_generation) {
+        memset(tc, 0, sizeof(tcache));
+        tc->generation = heap_generation;
+        tc->home = &arenas[__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % narenas];
+        tc->check_seed = (uint32_t)((uintptr_t)tc >> 4) | 1;
+        tc->check_countdown = (check_interval != 0) ? next_check(tc) : 0;
+        pthread_once(&tcache_once, create_tcache_key);
+        pthread_setspecific(tcache_key, tc);
+    }
+    return tc;
+}
+​
+/* Function: tcache_refill
+ * ___________________
+ * Parameters:
+ *    - tc: thread cache
+ *    - size: rounded request size (<= TCACHE_MAX) whose bin is empty
+ *
+ * Return: block for the current request, NULL if every arena is out of memory
+ *
+ * Description: This function takes the home arena's lock once, drains its remote frees and allocates up to 
+ *              TCACHE_BATCH blocks of the requested size. The first is returned to the caller and the rest are cached.
+ *              A block that came back bigger than requested (split slack absorbed by heap_malloc) goes to the bin for
+ *              its own size, or back to the arena if that bin is already full. If the home arena is out of memory the
+ *              request alone is sent to arena_malloc (which tries the other arenas and then growth).
+ */
+void *tcache_refill(tcache *tc, size_t size) {
+    arena *ar = home_arena(tc);
+    lock_arena(ar);
+    remote_drain(ar);
+    void *first = heap_malloc(ar, size);
+    for(int i = 1; first != NULL && i < TCACHE_BATCH; i++) {
+        void *block = heap_malloc(ar, size);
+        if(block == NULL) {
+            break;
+        }
+        size_t block_size = get_block_size(block);
+        if(block_size <= TCACHE_MAX && tc->counts[get_tcache_bin(block_size)] < TCACHE_COUNT) {
+            tcache_push(tc, block, block_size);
+        } else {
+            heap_free(ar, block);
+        }
+    }
+    unlock_arena(ar);
+    return (first != NULL) ? first : arena_malloc(ar, size, 0, false);
+}
+​
+/* Function: init_arena
+ * ___________________
+ * Parameters:
+ *    - ar: arena to set up
+ *    - start: start of the arena's slice of the segment
+ *    - size: size of the slice (multiple of 8)
+ *    - grow_size: size of the first mapping grow_arena makes (0 disables growth)
+ *    - zeroed: the slice is known to be zero-filled, so its free block starts out DECOMMITTED
+ *
+ * Return: N/A
+ *
+ * Description: This function lays the slice out as one free block followed by the epilogue header and resets the
+ *              arena's counters, free lists and lock.
+ */
+void init_arena(arena *ar, void *start, size_t size, size_t grow_size, bool zeroed) {
+    pthread_mutex_init(&ar->lock, NULL);
+    ar->base.start_block = (char *)start + WIDTH;
+    ar->base.segment_end = (char *)start + size;
+    ar->base.next = NULL;
+    ar->top = &ar->base;
+    ar->grow_size = grow_size;
+    create_hdr(start, size - 2 * WIDTH);
+    (*get_hdr(ar->base.segment_end)).block_size = ALLOC;
+    
+    memset(ar->free_lists, 0, sizeof(ar->free_lists));
+    memset(ar->class_map, 0, sizeof(ar->class_map));
+    memset(ar->sides, 0, sizeof(ar->sides));
+    memset(ar->addr_trees, 0, sizeof(ar->addr_trees));
+    ar->size_tree = NULL;
+    ar->wilderness = NULL;
+    memset(ar->quick, 0, sizeof(ar->quick));
+    ar->nquick = 0;
+    ar->remote_frees = NULL;
+    ar->coalesces = 0;
+    ar->splits = 0;
+    ar->searches = 0;
+    ar->probes = 0;
+    insert_free(ar, ar->base.start_block);
+    if(zeroed) {
+        (*get_hdr(ar->base.start_block)).block_size |= DECOMMITTED;
+    }
+    
+    ar->nblocks = 1;
+    ar->nused = 0;
+}
+​
+/* Function: validate_tree
+ * ___________________
+ * Parameters:
+ *    - ar: arena whose size tree is checked (caller holds its lock)
+ *    - n_free: number of free blocks not yet found on a list or in a tree, decremented for every tree block
+ *
+ * Return: true if the size tree is ordered and every chain is consistent, false otherwise
+ *
+ * Description: This function walks the tree in order without a stack (Morris traversal): before descending into a
+ *              left subtree, the subtree's largest node gets a temporary right link back to the current node, 
+ *              which is removed on the way back up. The walk always runs to the end so every link is restored.
+ */
+bool validate_tree(arena *ar, int *n_free) {
+    bool valid = true;
+    size_t last_size = 0;
+    void *curr = ar->size_tree;
+    
+    while(curr != NULL) {
+        void *pred = get_node(curr)->left;
+        if(pred != NULL) {
+            while(get_node(pred)->right != NULL && get_node(pred)->right != curr) {
+                pred = get_node(pred)->right;
+            }
+            if(get_node(pred)->right == NULL) {
+                get_node(pred)->right = curr;
+                curr = get_node(curr)->left;
+                continue;
+            }
+            get_node(pred)->right = NULL;
+        }
+        
+        size_t size = get_block_size(curr);
+        if(size <= last_size || !uses_tree(size) || get_prev_free(curr) != NULL) {
+            valid = false;
+        }
+        last_size = size;
+        for(void *block = curr; block != NULL; block = get_next_free(block)) {
+            void *next = get_next_free(block);
+            if(check_alloc(block) || get_block_size(block) != size || (next != NULL && get_prev_free(next) != block)) {
+                valid = false;
+                break;
+            }
+            *n_free -= 1;
+        }
+        curr = get_node(curr)->right;
+    }
+    return valid;
+}
+​
+/* Function: validate_side
+ * ___________________
+ * Parameters:
+ *    - ar: arena to check
+ *    - cls: multi-size class (>= NUM_EXACT_CLASSES)
+ *    - list_length: number of blocks on the class's free list
+ *
+ * Return: true if every side_array entry is a block on the class's list with its current size, and the array
+ *         mirrors the whole list unless it has overflowed
+ */
+bool validate_side(arena *ar, int cls, size_t list_length) {
+    side_array *side = &ar->sides[cls - NUM_EXACT_CLASSES];
+    if(side->count > SIDE_SLOTS || side->count > list_length || (!side->overflow && side->count != list_length)) {
+        return false;
+    }
+    for(uint32_t i = 0; i < side->count; i++) {
+        void *block = side->blocks[i];
+        if(check_alloc(block) || get_block_size(block) != side->sizes[i] || get_class(side->sizes[i]) != cls) {
+            return false;
+        }
+        void *curr_free_block = ar->free_lists[cls];
+        while(curr_free_block != NULL && curr_free_block != block) {
+            curr_free_block = get_next_free(curr_free_block);
+        }
+        if(curr_free_block == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+​
+/* Function: validate_arena
+ * ___________________
+ * Parameters:
+ *    - ar: arena to check (caller holds its lock)
+ *
+ * Return: true if the arena's blocks and free lists are consistent, false otherwise
+ *
+ * Description: This function walks every block in each of the arena's chunks, checking that the sizes add up to the
+ *              chunk, every payload is on block_align, the footers and PREV_FREE bits match, and the block and free
+ *              counts match the counters. It then walks every free list (and the size tree) checking the links, the
+ *              class of each block, and that every free block is on exactly one list.
+ */
+bool validate_arena(arena *ar) {
+    size_t block_count = 0;
+    int free_count = 0;
+    int n_free = ar->nblocks - ar->nused;
+    
+    for(chunk *ch = &ar->base; ch != NULL; ch = ch->next) {
+        void *curr_block = ch->start_block;
+        size_t used_bytes = 0;
+        size_t free_bytes = 0;
+        
+        while(curr_block < ch->segment_end && block_count < ar->nblocks) {
+            size_t block_width_size = get_block_size(curr_block) + WIDTH;
+            void *next_block = get_next_block(curr_block);
+            if(((uintptr_t)curr_block & (block_align - 1)) != 0) {
+                return false;
+            }
+            if(check_alloc(curr_block)) {
+                used_bytes += block_width_size;
+            } else {
+                free_count += 1;
+                free_bytes += block_width_size;
+                if(get_block_size(curr_block) > min_size && *((size_t *)get_hdr(next_block) - 1) != get_block_size(curr_block)) {
+                    return false;
+                }
+            }
+            if(check_prev_free(next_block) == check_alloc(curr_block)) {
+                return false;
+            }
+            curr_block = next_block;
+            block_count += 1;
+        }
+        
+        if(curr_block != ch->segment_end || used_bytes + free_bytes != (size_t)((char *)ch->segment_end - (char *)ch->start_block)) {
+            return false;
+        }
+    }
+
+    if(block_count != ar->nblocks || free_count != n_free) {
+        return false;
+    }
+    if(ar->wilderness != NULL) {
+        if(check_alloc(ar->wilderness) || get_next_block(ar->wilderness) != ar->top->segment_end) {
+            return false;
+        }
+        n_free -= 1;
+    }
+    size_t quick_count = 0;
+    for(int bin = 0; bin < QUICK_BINS; bin++) {
+        for(void *block = ar->quick[bin]; block != NULL; block = *(void **)block) {
+            if(!check_alloc(block) || get_quick_bin(get_block_size(block)) != bin || ++quick_count > ar->nquick) {
+                return false;
+            }
+        }
+    }
+    if(quick_count != ar->nquick) {
+        return false;
+    }
+​
+    for(int cls = 0; cls < NUM_CLASSES; cls++) {
+        void *curr_free_block = ar->free_lists[cls];
+        bool marked = (ar->class_map[cls >> 6] >> (cls & 63)) & 0x1;
+        size_t list_length = 0;
+        
+        if(marked != (curr_free_block != NULL)) {
+            return false;
+        }
+        if(curr_free_block != NULL && get_prev_free(curr_free_block) != NULL) {
+            return false;
+        }
+        while(curr_free_block != NULL) {
+            size_t size = get_block_size(curr_free_block);
+            if(check_alloc(curr_free_block) || get_class(size) != cls || uses_tree(size)) {
+                return false;
+            }
+            void *next_free_block = get_next_free(curr_free_block);
+            if(next_free_block != NULL && get_prev_free(next_free_block) != curr_free_block) {
+                return false;
+            }
+            if(uses_addr_order(size) && next_free_block != NULL && next_free_block < curr_free_block) {
+                return false;
+            }
+            if(--n_free < 0) {
+                return false;
+            }
+            list_length += 1;
+            curr_free_block = next_free_block;
+        }
+        if(cls >= NUM_EXACT_CLASSES && !validate_side(ar, cls, list_length)) {
+            return false;
+        }
+        if(cls >= NUM_EXACT_CLASSES && (ar->addr_trees[cls - NUM_EXACT_CLASSES] != NULL) != (fit_policy == FIT_ADDRESS && list_length != 0)) {
+            return false;
+        }
+    }
+
+    if(!validate_tree(ar, &n_free) || n_free != 0) {
+        return false;
+    }
+    return true;
+}
+​
+/* Function: chunk_of
+ * ___________________
+ * Parameters:
+ *    - ar: arena to look in (caller holds its lock)
+ *    - ptr: any address
+ *
+ * Return: the arena chunk whose blocks span ptr, NULL if there is none
+ */
+chunk *chunk_of(arena *ar, void *ptr) {
+    for(chunk *ch = &ar->base; ch != NULL; ch = ch->next) {
+        if(ptr >= ch->start_block && ptr < ch->segment_end) {
+            return ch;
+        }
+    }
+    return NULL;
+}
+​
+/* Function: check_block
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to (caller holds its lock)
+ *    - ch: chunk the block lies in
+ *    - block_ptr: pointer to start of block
+ *
+ * Return: true if the block looks intact, false otherwise
+ *
+ * Description: This function checks one block against its immediate surroundings only: the payload is on 
+ *              block_align, the block ends inside ch and the next block's PREV_FREE bit matches its status. A free
+ *              block must also have a matching footer and, unless it is the wilderness or kept in the size tree,
+ *              free list neighbors that are free blocks of the same arena linking back to it (or be the head of 
+ *              its class's list). Pointers are bounds-checked against ar's chunks before they are followed, so a
+ *              corrupt block is reported rather than crashing the check.
+ */
+bool check_block(arena *ar, chunk *ch, void *block_ptr) {
+    size_t size = get_block_size(block_ptr);
+    if(((uintptr_t)block_ptr & (block_align - 1)) != 0 || size < min_size || size + WIDTH > (size_t)((char *)ch->segment_end - (char *)block_ptr)) {
+        return false;
+    }
+    void *next_block = get_next_block(block_ptr);
+    if(check_prev_free(next_block) == check_alloc(block_ptr)) {
+        return false;
+    }
+    if(check_alloc(block_ptr)) {
+        return true;
+    }
+    if(size > min_size && *((size_t *)get_hdr(next_block) - 1) != size) {
+        return false;
+    }
+    if(block_ptr == ar->wilderness || uses_tree(size)) {
+        return true;
+    }
+    void *next_free = get_next_free(block_ptr);
+    void *prev_free = get_prev_free(block_ptr);
+    if(next_free != NULL && (chunk_of(ar, next_free) == NULL || check_alloc(next_free) || get_prev_free(next_free) != block_ptr)) {
+        return false;
+    }
+    if(prev_free == NULL) {
+        return ar->free_lists[get_class(size)] == block_ptr;
+    }
+    return chunk_of(ar, prev_free) != NULL && !check_alloc(prev_free) && get_next_free(prev_free) == block_ptr;
+}
+​
+/* Function: check_freed
+ * ___________________
+ * Parameters:
+ *    - ptr: arena block about to be freed
+ *
+ * Return: N/A
+ *
+ * Description: This is the sampled check myfree runs on about one in check_interval frees. Under the owning 
+ *              arena's lock it checks that the block is inside one of the arena's chunks and still allocated 
+ *              (catching most double frees), then runs check_block on it, on its right neighbor and on its left
+ *              neighbor when that one is free, which covers the headers, footers and free list links a stray write
+ *              past either end of the block would have damaged. Corruption is reported on stderr and aborts, 
+ *              since freeing into a damaged heap would only spread it.
+ */
+void check_freed(void *ptr) {
+    arena *ar = arena_of(ptr);
+    bool valid = false;
+    if(ar != NULL) {
+        lock_arena(ar);
+        chunk *ch = chunk_of(ar, ptr);
+        valid = ch != NULL && check_alloc(ptr) && check_block(ar, ch, ptr);
+        if(valid && check_prev_free(ptr)) {
+            void *prev_block = get_prev_block(ptr);
+            valid = chunk_of(ar, prev_block) == ch && check_block(ar, ch, prev_block) && get_next_block(prev_block) == ptr;
+        }
+        if(valid && get_next_block(ptr) != ch->segment_end) {
+            valid = check_block(ar, ch, get_next_block(ptr));
+        }
+        unlock_arena(ar);
+    }
+    if(!valid) {
+        fprintf(stderr, "myfree: heap corruption detected at block %p\n", ptr);
+        abort();
+    }
+}
+​
+​
+//LARGE (MMAP) BLOCKS:
+//_____________________
+​
+/* Function: write_mmap_hdr
+ * ___________________
+ * Parameters:
+ *    - map: start of a mapping holding one large block
+ *    - len: length of the mapping
+ *
+ * Return: pointer to the start of the block
+ *
+ * Description: This function writes the header of the block that fills the mapping. The payload starts block_align
+ *              bytes in (so the header sits at the very start unless blocks are 16-byte aligned) and the block's size
+ *              is everything after it, so myfree can recover the mapping's length from the header alone.
+ */
+void *write_mmap_hdr(void *map, size_t len) {
+    void *block = (char *)map + block_align;
+    (*get_hdr(block)).block_size = ((len - block_align) << 2) | MMAPPED | ALLOC;
+    return block;
+}
+​
+/* Function: mmap_start
+ * ___________________
+ * Parameters:
+ *    - ptr: pointer to start of an MMAPPED block
+ *
+ * Return: start of the block's mapping
+ */
+void *mmap_start(void *ptr) {
+    return (char *)ptr - block_align;
+}
+​
+/* Function: mmap_alloc
+ * ___________________
+ * Parameters:
+ *    - size: rounded request size (>= mmap_threshold)
+ *
+ * Return: pointer to a block in its own mapping, NULL if the mapping failed
+ *
+ * Description: Large blocks never go near the arenas, so freeing them can't leave a huge hole that first_fit has to
+ *              step over for the rest of the process.
+ */
+void *mmap_alloc(size_t size) {
+    size_t len = page_round(size + block_align);
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(map == MAP_FAILED) {
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if(huge_pages && len >= HUGE_PAGE_SIZE) {
+        madvise(map, len, MADV_HUGEPAGE);
+    }
+#endif
+    __atomic_fetch_add(&mmap_bytes, len, __ATOMIC_RELAXED);
+    return write_mmap_hdr(map, len);
+}
+​
+/* Function: mmap_free
+ * ___________________
+ * Parameters:
+ *    - ptr: pointer to start of an MMAPPED block
+ *
+ * Return: N/A
+ *
+ * Description: This function gives the block's whole mapping back to the OS.
+ */
+void mmap_free(void *ptr) {
+    __atomic_fetch_sub(&mmap_bytes, get_block_size(ptr) + block_align, __ATOMIC_RELAXED);
+    munmap(mmap_start(ptr), get_block_size(ptr) + block_align);
+}
+​
+/* Function: mmap_realloc
+ * ___________________
+ * Parameters:
+ *    - old_ptr: pointer to start of an MMAPPED block
+ *    - size: rounded new size (>= mmap_threshold)
+ *
+ * Return: pointer to the resized block, NULL if the mapping couldn't be resized (old_ptr is left untouched)
+ *
+ * Description: This function resizes the block's mapping with mremap, which grows it in place when the address 
+ *              space after it is free and otherwise moves the pages without copying them.
+ */
+void *mmap_realloc(void *old_ptr, size_t size) {
+    size_t old_len = get_block_size(old_ptr) + block_align;
+    size_t len = page_round(size + block_align);
+    if(len == old_len) {
+        return old_ptr;
+    }
+    void *map = mremap(mmap_start(old_ptr), old_len, len, MREMAP_MAYMOVE);
+    if(map == MAP_FAILED) {
+        return NULL;
+    }
+    __atomic_fetch_add(&mmap_bytes, len - old_len, __ATOMIC_RELAXED);
+    return write_mmap_hdr(map, len);
+}
+​
+​
+//SLABS FOR TINY OBJECTS:
+//________________________
+​
+/* Function: in_slab_range
+ * ___________________
+ * Parameters:
+ *    - ptr: pointer handed out by mymalloc
+ *
+ * Return: true if the pointer is a slab slot, false if it belongs to the arenas or a mapping
+ */
+bool in_slab_range(void *ptr) {
+    return (size_t)((char *)ptr - (char *)slab_base) < slab_limit * SLAB_SIZE;
+}
+​
+/* Function: slab_of
+ * ___________________
+ * Parameters:
+ *    - ptr: pointer to a slab slot
+ *
+ * Return: pointer to the slab holding the slot
+ */
+slab *slab_of(void *ptr) {
+    return (slab *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+}
+​
+/* Function: slab_push
+ * ___________________
+ * Parameters:
+ *    - cls: slab class (slot size / 8 - 1)
+ *    - sl: slab with free slots that isn't on the stack yet
+ *
+ * Return: N/A
+ *
+ * Description: This function pushes the slab onto the class's slab_partial stack. The head packs the slab's index
+ *              (plus one, so 0 means empty) in the low 32 bits and a counter that changes on every push and pop in
+ *              the high 32 bits, which keeps a compare-and-swap from succeeding on a head that was popped and 
+ *              pushed back in between (the ABA problem). Slabs are never unmapped, so reading a stale next is safe.
+ */
+void slab_push(int cls, slab *sl) {
+    uint64_t index = (size_t)((char *)sl - (char *)slab_base) / SLAB_SIZE + 1;
+    uint64_t head = __atomic_load_n(&slab_partial[cls], __ATOMIC_ACQUIRE);
+    uint64_t new_head;
+    do {
+        __atomic_store_n(&sl->next, (uint32_t)head, __ATOMIC_RELAXED);
+        new_head = (((head >> 32) + 1) << 32) | index;
+    } while(!__atomic_compare_exchange_n(&slab_partial[cls], &head, new_head, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+}
+​
+/* Function: slab_pop
+ * ___________________
+ * Parameters:
+ *    - cls: slab class
+ *
+ * Return: a slab that had free slots when it was pushed, NULL if the stack is empty
+ */
+slab *slab_pop(int cls) {
+    uint64_t head = __atomic_load_n(&slab_partial[cls], __ATOMIC_ACQUIRE);
+    slab *sl;
+    uint64_t new_head;
+    do {
+        if((uint32_t)head == 0) {
+            return NULL;
+        }
+        sl = (slab *)((char *)slab_base + ((uint32_t)head - 1) * (size_t)SLAB_SIZE);
+        new_head = (((head >> 32) + 1) << 32) | __atomic_load_n(&sl->next, __ATOMIC_RELAXED);
+    } while(!__atomic_compare_exchange_n(&slab_partial[cls], &head, new_head, true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    __atomic_store_n(&sl->listed, 0, __ATOMIC_RELEASE);
+    return sl;
+}
+​
+/* Function: slab_claim
+ * ___________________
+ * Parameters:
+ *    - sl: slab to take a slot from
+ *
+ * Return: pointer to a slot that now belongs to the caller, NULL if the slab is full
+ *
+ * Description: This function clears the lowest set bit of the first bitmap word that has one with a 
+ *              compare-and-swap, retrying on the word's new value when another thread got there first.
+ */
+void *slab_claim(slab *sl) {
+    for(int word = 0; word < SLAB_WORDS; word++) {
+        uint64_t bits = __atomic_load_n(&sl->bitmap[word], __ATOMIC_RELAXED);
+        while(bits != 0) {
+            int bit = __builtin_ctzll(bits);
+            if(__atomic_compare_exchange_n(&sl->bitmap[word], &bits, bits & ~(1ULL << bit), true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                return (char *)sl + sizeof(slab) + (size_t)(word * 64 + bit) * sl->slot_size;
+            }
+        }
+    }
+    return NULL;
+}
+​
+/* Function: new_slab
+ * ___________________
+ * Parameters:
+ *    - cls: slab class
+ *
+ * Return: freshly initialized slab with every slot free, NULL if the slab range is used up
+ */
+slab *new_slab(int cls) {
+    size_t index = __atomic_fetch_add(&slab_count, 1, __ATOMIC_RELAXED);
+    if(index >= slab_limit) {
+        return NULL;
+    }
+    slab *sl = (slab *)((char *)slab_base + index * SLAB_SIZE);
+    sl->slot_size = (cls + 1) * WIDTH;
+    sl->nslots = (SLAB_SIZE - sizeof(slab)) / sl->slot_size;
+    sl->next = 0;
+    sl->listed = 0;
+    for(int word = 0; word < SLAB_WORDS; word++) {
+        int nbits = (int)sl->nslots - word * 64;
+        sl->bitmap[word] = (nbits >= 64) ? ~0ULL : (nbits > 0) ? (1ULL << nbits) - 1 : 0;
+    }
+    return sl;
+}
+​
+/* Function: slab_alloc
+ * ___________________
+ * Parameters:
+ *    - req_size: requested size (<= SLAB_MAX)
+ *
+ * Return: pointer to a slot of at least req_size bytes, NULL if the slab range is used up
+ *
+ * Description: This function claims a slot from the class's current slab. When that slab is full, the next slab 
+ *              with free slots comes off slab_partial (or a new one is carved from the slab range) and is swapped
+ *              in as the current slab. If another thread swapped first, the slab that lost the race (popped or
+ *              new) goes back onto slab_partial unless a concurrent free already listed it.
+ */
+void *slab_alloc(size_t req_size) {
+    int cls = ((req_size + block_align - 1) & ~(block_align - 1)) / WIDTH - 1;
+    while(true) {
+        slab *curr = __atomic_load_n(&slab_current[cls], __ATOMIC_ACQUIRE);
+        void *slot = (curr != NULL) ? slab_claim(curr) : NULL;
+        if(slot != NULL) {
+            return slot;
+        }
+        
+        slab *next = slab_pop(cls);
+        if(next == NULL && (next = new_slab(cls)) == NULL) {
+            return NULL;
+        }
+        if(!__atomic_compare_exchange_n(&slab_current[cls], &curr, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+           && __atomic_exchange_n(&next->listed, 1, __ATOMIC_ACQ_REL) == 0) {
+            slab_push(cls, next);
+        }
+    }
+}
+​
+/* Function: slab_free
+ * ___________________
+ * Parameters:
+ *    - ptr: pointer to a slab slot
+ *
+ * Return: N/A
+ *
+ * Description: This function sets the slot's bit. If the slab isn't the current slab and isn't already on the stack
+ *              (listed is claimed with an atomic exchange, so only one freeing thread pushes it), it goes onto 
+ *              slab_partial so its free slots get reused.
+ */
+void slab_free(void *ptr) {
+    slab *sl = slab_of(ptr);
+    size_t slot = (size_t)((char *)ptr - (char *)sl - sizeof(slab)) / sl->slot_size;
+    __atomic_fetch_or(&sl->bitmap[slot / 64], 1ULL << (slot % 64), __ATOMIC_RELEASE);
+    
+    int cls = sl->slot_size / WIDTH - 1;
+    if(__atomic_load_n(&slab_current[cls], __ATOMIC_RELAXED) != sl && __atomic_exchange_n(&sl->listed, 1, __ATOMIC_ACQ_REL) == 0) {
+        slab_push(cls, sl);
+    }
+}
+​
+/* Function: init_slabs
+ * ___________________
+ * Parameters:
+ *    - region_size: bytes of address space to reserve for slabs (0 disables slabs)
+ *
+ * Return: true if the range could be reserved (or slabs are disabled), false otherwise
+ *
+ * Description: This function is called by myinit_config. It drops the previous heap's slab range and reserves a 
+ *              new one. The range is mapped MAP_NORESERVE, so slabs only cost memory once they are touched.
+ */
+bool init_slabs(size_t region_size) {
+    if(slab_base != NULL) {
+        munmap(slab_base, slab_limit * SLAB_SIZE);
+    }
+    slab_base = NULL;
+    slab_limit = 0;
+    slab_count = 0;
+    memset(slab_current, 0, sizeof(slab_current));
+    memset(slab_partial, 0, sizeof(slab_partial));
+    
+    size_t limit = region_size / SLAB_SIZE;
+    if(limit == 0) {
+        return true;
+    }
+    void *map = mmap(NULL, limit * SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(map == MAP_FAILED) {
+        return false;
+    }
+#ifdef MADV_HUGEPAGE
+    if(huge_pages) {
+        madvise(map, limit * SLAB_SIZE, MADV_HUGEPAGE);
+    }
+#endif
+    slab_base = map;
+    slab_limit = limit;
+    return true;
+}
+​
+​
+//REGIONS:
+//_________
+​
+/* Struct: myregion
+ * ________________
+ * Description: The "myregion" struct sits at the start of the region's first block, followed by the bump area. 
+ *              Allocations are carved from cursor up to limit with no header. When a request doesn't fit, a new 
+ *              overflow block is taken from the heap and pushed onto overflow (its first word links to the next 
+ *              one), and bumping continues in it.
+ *    - cursor / limit: next free byte and end of the block currently being bumped through
+ *    - overflow: most recent overflow block, NULL while everything still fits in the first block
+ *    - size: size of the first block's bump area, also the minimum size of each overflow block
+ */
+struct myregion {
+    char *cursor;
+    char *limit;
+    void *overflow;
+    size_t size;
+};
+​
+/* Function: region_block
+ * ___________________
+ * Parameters:
+ *    - size: rounded block size
+ *
+ * Return: pointer to a new heap block of at least size bytes, NULL if out of memory
+ *
+ * Description: This function allocates a region's backing block straight from the home arena (or the mmap path 
+ *              for blocks of at least mmap_threshold bytes), skipping the slabs and the thread cache so that 
+ *              region_release hands the memory back to the free lists rather than a cache bin.
+ */
+void *region_block(size_t size) {
+    if(mmap_threshold != 0 && size >= mmap_threshold) {
+        return mmap_alloc(size);
+    }
+    return arena_malloc(home_arena(get_tcache()), size, 0, false);
+}
+​
+/* Function: region_release
+ * ___________________
+ * Parameters:
+ *    - block: block returned by region_block
+ *
+ * Return: N/A
+ *
+ * Description: This function unmaps an MMAPPED block, or frees the block in its arena, where heap_free coalesces 
+ *              it with its neighbors and files it as one free block.
+ */
+void region_release(void *block) {
+    if((*get_hdr(block)).block_size & MMAPPED) {
+        mmap_free(block);
+        return;
+    }
+    arena *ar = arena_of(block);
+    lock_arena(ar);
+    heap_free(ar, block);
+    unlock_arena(ar);
+}
+​
+/* Function: release_overflow
+ * ___________________
+ * Parameters:
+ *    - r: region whose overflow blocks are released
+ *
+ * Return: N/A
+ */
+void release_overflow(myregion *r) {
+    while(r->overflow != NULL) {
+        void *next = *(void **)r->overflow;
+        region_release(r->overflow);
+        r->overflow = next;
+    }
+}
+​
+/* Function: myregion_create
+ * ___________________
+ * Parameters:
+ *    - size: number of bytes the region should hold before it needs an overflow block
+ *
+ * Return: pointer to the new region, NULL if size is 0 or the heap is out of memory
+ *
+ * Description: This function takes one block big enough for the myregion struct plus size bytes from the heap. A 
+ *              region isn't locked, so only one thread at a time may use it.
+ */
+myregion *myregion_create(size_t size) {
+    size_t head = (sizeof(myregion) + block_align - 1) & ~(block_align - 1);
+    if(size == 0 || size > SIZE_MAX / 2 - head) {
+        return NULL;
+    }
+    myregion *r = region_block(round_up(head + size));
+    if(r == NULL) {
+        return NULL;
+    }
+    r->cursor = (char *)r + head;
+    r->limit = (char *)r + get_block_size(r);
+    r->overflow = NULL;
+    r->size = size;
+    return r;
+}
+​
+/* Function: myregion_alloc
+ * ___________________
+ * Parameters:
+ *    - r: region to allocate from
+ *    - req_size: requested block size
+ *
+ * Return: pointer to req_size bytes aligned like any mymalloc block, NULL if req_size is 0 or out of memory
+ *
+ * Description: This function bumps the cursor past the request. When the current block is used up, it starts an
+ *              overflow block of at least the region's size (more if the request alone is bigger), and whatever
+ *              was left in the previous block goes unused until the region is reset. Region blocks can't be passed
+ *              to myfree or myrealloc.
+ */
+void *myregion_alloc(myregion *r, size_t req_size) {
+    if(req_size == 0 || req_size > SIZE_MAX / 2) {
+        return NULL;
+    }
+    size_t size = (req_size + block_align - 1) & ~(block_align - 1);
+    if(size > (size_t)(r->limit - r->cursor)) {
+        size_t link = (sizeof(void *) + block_align - 1) & ~(block_align - 1);
+        void *block = region_block(round_up(link + ((size > r->size) ? size : r->size)));
+        if(block == NULL) {
+            return NULL;
+        }
+        *(void **)block = r->overflow;
+        r->overflow = block;
+        r->cursor = (char *)block + link;
+        r->limit = (char *)block + get_block_size(block);
+    }
+    void *ptr = r->cursor;
+    r->cursor += size;
+    return ptr;
+}
+​
+/* Function: myregion_reset
+ * ___________________
+ * Parameters:
+ *    - r: region to empty
+ *
+ * Return: N/A
+ *
+ * Description: This function frees every block handed out by the region at once. Overflow blocks go back to the 
+ *              heap and the cursor rewinds to the start of the first block, which the region keeps for reuse, so a
+ *              region that never overflowed resets in O(1).
+ */
+void myregion_reset(myregion *r) {
+    release_overflow(r);
+    size_t head = (sizeof(myregion) + block_align - 1) & ~(block_align - 1);
+    r->cursor = (char *)r + head;
+    r->limit = (char *)r + get_block_size(r);
+}
+​
+/* Function: myregion_destroy
+ * ___________________
+ * Parameters:
+ *    - r: region to destroy (may be NULL)
+ *
+ * Return: N/A
+ *
+ * Description: This function returns the overflow blocks and then the region's own block to the heap, each as a
+ *              single free that coalesces with its neighbors, without visiting the allocations inside them.
+ */
+void myregion_destroy(myregion *r) {
+    if(r == NULL) {
+        return;
+    }
+    release_overflow(r);
+    region_release(r);
+}
+​
+​
+//OBJECT POOLS:
+//______________
+​
+/* Struct: pool_chunk
+ * __________________
+ * Description: The "pool_chunk" struct sits at the start of each chunk_size-aligned chunk of a pool, followed by 
+ *              nslots object slots. Free slots are chained through their first word with no header, so an object 
+ *              finds its chunk by masking its address.
+ *    - free: first free slot (NULL when every slot is in use)
+ *    - live: number of slots handed out
+ *    - listed: whether the chunk is on the pool's partial list
+ *    - prev / next: neighbors in the list of all the pool's chunks
+ *    - prev_partial / next_partial: neighbors in the partial list
+ */
+typedef struct pool_chunk {
+    void *free;
+    size_t live;
+    bool listed;
+    struct pool_chunk *prev;
+    struct pool_chunk *next;
+    struct pool_chunk *prev_partial;
+    struct pool_chunk *next_partial;
+} pool_chunk;
+​
+/* Struct: mypool
+ * ______________
+ * Description: The "mypool" struct is the handle mypool_create returns (it lives in its own heap block).
+ *    - current: chunk allocations are served from
+ *    - partial: other chunks that have free slots (chunks go on it when a free hits a full chunk)
+ *    - chunks: every chunk of the pool
+ *    - obj_size / first_slot / nslots: slot stride, offset of the first slot in a chunk and slots per chunk
+ *    - chunk_size: size and alignment of every chunk (a power of two)
+ *    - release_empty: give a chunk back to the heap as soon as its last object is freed
+ */
+struct mypool {
+    pool_chunk *current;
+    pool_chunk *partial;
+    pool_chunk *chunks;
+    size_t obj_size;
+    size_t first_slot;
+    size_t nslots;
+    size_t chunk_size;
+    bool release_empty;
+};
+​
+/* Function: pool_grow
+ * ___________________
+ * Parameters:
+ *    - pool: pool to add a chunk to
+ *
+ * Return: the new chunk, NULL if the heap is out of memory
+ *
+ * Description: This function takes a chunk_size-aligned block from the heap with myaligned_alloc and threads all 
+ *              of its slots onto the chunk's free list in address order, so later allocations never check a bump
+ *              pointer.
+ */
+pool_chunk *pool_grow(mypool *pool) {
+    pool_chunk *c = myaligned_alloc(pool->chunk_size, pool->chunk_size);
+    if(c == NULL) {
+        return NULL;
+    }
+    char *slot = (char *)c + pool->first_slot;
+    c->free = slot;
+    for(size_t i = 1; i < pool->nslots; i++) {
+        *(void **)slot = slot + pool->obj_size;
+        slot += pool->obj_size;
+    }
+    *(void **)slot = NULL;
+    c->live = 0;
+    c->listed = false;
+    c->prev = NULL;
+    c->next = pool->chunks;
+    if(pool->chunks != NULL) {
+        pool->chunks->prev = c;
+    }
+    pool->chunks = c;
+    c->prev_partial = NULL;
+    c->next_partial = NULL;
+    return c;
+}
+​
+/* Function: pool_unlist
+ * ___________________
+ * Parameters:
+ *    - pool: pool
+ *    - c: chunk on the pool's partial list
+ *
+ * Return: N/A
+ */
+void pool_unlist(mypool *pool, pool_chunk *c) {
+    if(c->prev_partial != NULL) {
+        c->prev_partial->next_partial = c->next_partial;
+    } else {
+        pool->partial = c->next_partial;
+    }
+    if(c->next_partial != NULL) {
+        c->next_partial->prev_partial = c->prev_partial;
+    }
+    c->listed = false;
+}
+​
+/* Function: pool_refill
+ * ___________________
+ * Parameters:
+ *    - pool: pool whose current chunk is full
+ *
+ * Return: a free object, NULL if the heap is out of memory
+ *
+ * Description: This is mypool_alloc's slow path. The first chunk on the partial list becomes the current chunk,
+ *              or a new chunk is taken from the heap when there is none. The old current chunk is full, so it 
+ *              stays off the partial list until one of its objects is freed.
+ */
+void *pool_refill(mypool *pool) {
+    pool_chunk *c = pool->partial;
+    if(c != NULL) {
+        pool_unlist(pool, c);
+    } else if((c = pool_grow(pool)) == NULL) {
+        return NULL;
+    }
+    pool->current = c;
+    void *obj = c->free;
+    c->free = *(void **)obj;
+    c->live += 1;
+    return obj;
+}
+​
+/* Function: pool_settle
+ * ___________________
+ * Parameters:
+ *    - pool: pool
+ *    - c: chunk (not the current one) that just got its first free slot back or just became empty
+ *
+ * Return: N/A
+ *
+ * Description: This is mypool_free's slow path. A chunk that was full goes on the partial list. A chunk whose 
+ *              last object was freed goes back to the heap with myfree when the pool releases empty chunks.
+ */
+void pool_settle(mypool *pool, pool_chunk *c) {
+    if(!c->listed) {
+        c->listed = true;
+        c->prev_partial = NULL;
+        c->next_partial = pool->partial;
+        if(pool->partial != NULL) {
+            pool->partial->prev_partial = c;
+        }
+        pool->partial = c;
+    }
+    if(c->live == 0 && pool->release_empty) {
+        pool_unlist(pool, c);
+        if(c->prev != NULL) {
+            c->prev->next = c->next;
+        } else {
+            pool->chunks = c->next;
+        }
+        if(c->next != NULL) {
+            c->next->prev = c->prev;
+        }
+        myfree(c);
+    }
+}
+​
+/* Function: mypool_create
+ * ___________________
+ * Parameters:
+ *    - obj_size: size of every object
+ *    - align: alignment of every object (a power of two, 0 for block_align)
+ *
+ * Return: pointer to the new pool, NULL if obj_size is 0, align isn't a power of two or the heap is out of memory
+ *
+ * Description: Slots are obj_size rounded up to a pointer and to align. Chunks are POOL_CHUNK bytes, or the next 
+ *              power of two holding POOL_MIN_SLOTS slots for big objects, and the first one is taken right away so
+ *              mypool_alloc never has to check for a missing chunk. A pool isn't locked, so only one thread at a 
+ *              time may use it.
+ */
+mypool *mypool_create(size_t obj_size, size_t align) {
+    align = (align > block_align) ? align : block_align;
+    if(obj_size == 0 || obj_size > MAX_REQUEST / POOL_MIN_SLOTS || (align & (align - 1)) != 0 || align > MAX_REQUEST / POOL_MIN_SLOTS) {
+        return NULL;
+    }
+    size_t stride = (obj_size + align - 1) & ~(align - 1);
+    size_t first_slot = (sizeof(pool_chunk) + align - 1) & ~(align - 1);
+    size_t chunk_size = POOL_CHUNK;
+    while(chunk_size - first_slot < POOL_MIN_SLOTS * stride) {
+        chunk_size *= 2;
+    }
+    mypool *pool = mymalloc(sizeof(mypool));
+    if(pool == NULL) {
+        return NULL;
+    }
+    pool->partial = NULL;
+    pool->chunks = NULL;
+    pool->obj_size = stride;
+    pool->first_slot = first_slot;
+    pool->nslots = (chunk_size - first_slot) / stride;
+    pool->chunk_size = chunk_size;
+    pool->release_empty = false;
+    if((pool->current = pool_grow(pool)) == NULL) {
+        myfree(pool);
+        return NULL;
+    }
+    return pool;
+}
+​
+/* Function: mypool_release_empty
+ * ___________________
+ * Parameters:
+ *    - pool: pool
+ *    - release: whether chunks should go back to the heap once they are empty
+ *
+ * Return: N/A
+ *
+ * Description: Releasing is off by default. The current chunk is never released, so a pool that keeps 
+ *              allocating and freeing a few objects doesn't hand the same chunk back and forth with the heap.
+ */
+void mypool_release_empty(mypool *pool, bool release) {
+    pool->release_empty = release;
+}
+​
+/* Function: mypool_alloc
+ * ___________________
+ * Parameters:
+ *    - pool: pool to allocate from
+ *
+ * Return: pointer to a free object, NULL if the heap is out of memory
+ *
+ * Description: This function pops the current chunk's free list. Only when that list is empty does it go to 
+ *              pool_refill.
+ */
+void *mypool_alloc(mypool *pool) {
+    pool_chunk *c = pool->current;
+    void *obj = c->free;
+    if(obj == NULL) {
+        return pool_refill(pool);
+    }
+    c->free = *(void **)obj;
+    c->live += 1;
+    return obj;
+}
+​
+/* Function: mypool_free
+ * ___________________
+ * Parameters:
+ *    - pool: pool the object came from
+ *    - ptr: object to free (may be NULL)
+ *
+ * Return: N/A
+ *
+ * Description: This function finds the object's chunk by masking its address and pushes the object onto the 
+ *              chunk's free list. pool_settle only runs when the chunk was full or has just become empty, and 
+ *              never for the current chunk. Pool objects can't be passed to myfree or myrealloc. They aren't
+ *              heap blocks, so check_freed doesn't apply to them; the chunks are checked as they go back to the
+ *              heap through myfree.
+ */
+void mypool_free(mypool *pool, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    pool_chunk *c = (pool_chunk *)((uintptr_t)ptr & ~(uintptr_t)(pool->chunk_size - 1));
+    void *next = c->free;
+    *(void **)ptr = next;
+    c->free = ptr;
+    c->live -= 1;
+    if(c != pool->current && (next == NULL || c->live == 0)) {
+        pool_settle(pool, c);
+    }
+}
+​
+/* Function: mypool_destroy
+ * ___________________
+ * Parameters:
+ *    - pool: pool to destroy (may be NULL)
+ *
+ * Return: N/A
+ *
+ * Description: This function gives every chunk back to the heap, along with every object still in them, and then 
+ *              the pool's own block.
+ */
+void mypool_destroy(mypool *pool) {
+    if(pool == NULL) {
+        return;
+    }
+    while(pool->chunks != NULL) {
+        pool_chunk *next = pool->chunks->next;
+        myfree(pool->chunks);
+        pool->chunks = next;
+    }
+    myfree(pool);
+}
+​
+​
+//TRIMMING:
+//__________
+​
+/* Function: trim_arena
+ * ___________________
+ * Parameters:
+ *    - ar: arena to trim (caller holds its lock)
+ *
+ * Return: number of bytes handed back to the kernel
+ *
+ * Description: This function drains remote frees and consolidates the quick lists so freed blocks can merge into
+ *              larger runs, then walks every chunk and releases the interior pages of each free block with 
+ *              madvise(MADV_DONTNEED). The block is marked DECOMMITTED so later calls skip it. Nothing else changes:
+ *              the pages fault back in (zero-filled) when the block is reused, and insert_free clears the mark once the
+ *              block is split or merged.
+ */
+size_t trim_arena(arena *ar) {
+    size_t released = 0;
+    remote_drain(ar);
+    consolidate(ar);
+    for(chunk *ch = &ar->base; ch != NULL; ch = ch->next) {
+        for(void *curr_block = ch->start_block; curr_block < ch->segment_end; curr_block = get_next_block(curr_block)) {
+            char *start;
+            char *end;
+            if(check_alloc(curr_block) || ((*get_hdr(curr_block)).block_size & DECOMMITTED) || 
+               !trim_range(curr_block, &start, &end)) {
+                continue;
+            }
+            if(madvise(start, end - start, MADV_DONTNEED) == 0) {
+                (*get_hdr(curr_block)).block_size |= DECOMMITTED;
+                released += end - start;
+            }
+        }
+    }
+    return released;
+}
+​
+/* Function: mytrim
+ * ___________________
+ * Return: number of bytes handed back to the kernel by this call
+ *
+ * Description: This function trims each arena in turn under its lock (see trim_arena), so it can be called from 
+ *              a background thread while others keep allocating. Blocks in per-thread caches and slabs are left
+ *              alone.
+ */
+size_t mytrim(void) {
+    size_t released = 0;
+    for(size_t i = 0; i < narenas; i++) {
+        lock_arena(&arenas[i]);
+        released += trim_arena(&arenas[i]);
+        unlock_arena(&arenas[i]);
+    }
+    return released;
+}
+​
+​
+//STATISTICS:
+//____________
+​
+/* Function: retire_counts
+ * ___________________
+ * Parameters:
+ *    - arg: pointer to the exiting thread's call_counts (registered with pthread_setspecific)
+ *
+ * Return: N/A
+ *
+ * Description: This function runs as the counts_key destructor. It folds the thread's counts into retired_counts
+ *              (unless they belong to an older heap) and unlinks them from counts_list before the thread's 
+ *              storage goes away.
+ */
+void retire_counts(void *arg) {
+    call_counts *cc = arg;
+    pthread_mutex_lock(&counts_lock);
+    if(cc->generation == heap_generation) {
+        retired_counts.mallocs += cc->mallocs;
+        retired_counts.frees += cc->frees;
+        retired_counts.reallocs += cc->reallocs;
+        retired_counts.reallocs_in_place += cc->reallocs_in_place;
+        retired_counts.reallocs_moved += cc->reallocs_moved;
+    }
+    if(cc->prev != NULL) {
+        cc->prev->next = cc->next;
+    } else {
+        counts_list = cc->next;
+    }
+    if(cc->next != NULL) {
+        cc->next->prev = cc->prev;
+    }
+    pthread_mutex_unlock(&counts_lock);
+}
+​
+/* Function: create_counts_key
+ * ___________________
+ * Return: N/A
+ *
+ * Description: This function is run once (through pthread_once) to create the key whose destructor retires each
+ *              thread's counts on exit.
+ */
+void create_counts_key(void) {
+    pthread_key_create(&counts_key, retire_counts);
+}
+​
+/* Function: get_counts
+ * ___________________
+ * Return: pointer to the calling thread's call_counts
+ *
+ * Description: On a thread's first call (or its first call since myinit) this function links its counts into
+ *              counts_list if needed and zeroes them, under counts_lock so mystats never sees a half-reset copy.
+ */
+call_counts *get_counts(void) {
+    call_counts *cc = &thread_counts;
+    if(cc->generation != heap_generation) {
+        pthread_mutex_lock(&counts_lock);
+        if(!cc->registered) {
+            cc->registered = true;
+            cc->next = counts_list;
+            if(counts_list != NULL) {
+                counts_list->prev = cc;
+            }
+            counts_list = cc;
+            pthread_once(&counts_once, create_counts_key);
+            pthread_setspecific(counts_key, cc);
+        }
+        cc->mallocs = 0;
+        cc->frees = 0;
+        cc->reallocs = 0;
+        cc->reallocs_in_place = 0;
+        cc->reallocs_moved = 0;
+        cc->generation = heap_generation;
+        pthread_mutex_unlock(&counts_lock);
+    }
+    return cc;
+}
+​
+/* Function: count
+ * ___________________
+ * Parameters:
+ *    - counter: one of the calling thread's call_counts fields
+ *
+ * Return: N/A
+ *
+ * Description: Only the owning thread writes a counter, so a load and a relaxed store are enough (no locked add).
+ */
+void count(size_t *counter) {
+    __atomic_store_n(counter, *counter + 1, __ATOMIC_RELAXED);
+}
+​
+/* Function: count_many
+ * ___________________
+ * Parameters:
+ *    - counter: one of the calling thread's call_counts fields
+ *    - n: amount to add
+ *
+ * Return: N/A
+ */
+void count_many(size_t *counter, size_t n) {
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+​
+/* Function: stats_bucket
+ * ___________________
+ * Parameters:
+ *    - size: free block size
+ *
+ * Return: index of the free_histogram bucket for the size (floor of its log2, capped at the last bucket)
+ */
+int stats_bucket(size_t size) {
+    int log2 = 63 - __builtin_clzl(size);
+    return (log2 < STATS_BUCKETS) ? log2 : STATS_BUCKETS - 1;
+}
+​
+/* Function: mystats
+ * ___________________
+ * Return: a snapshot of the heap (see allocator_stats in explicit_allocator.h)
+ *
+ * Description: This function walks every chunk of each arena under that arena's lock, so the layout numbers are 
+ *              exact for each arena but the arenas are read one after another. Blocks sitting in thread caches are
+ *              allocated as far as the arenas know, so they count as used. The call counters are added up from 
+ *              retired_counts and every live thread's copy under counts_lock. Nothing here is touched by
+ *              mymalloc/myfree, so the hot path pays only for the per-thread increments.
+ */
+allocator_stats mystats(void) {
+    allocator_stats stats;
+    memset(&stats, 0, sizeof(stats));
+    size_t searches = 0;
+    size_t probes = 0;
+    
+    for(size_t i = 0; i < narenas; i++) {
+        arena *ar = &arenas[i];
+        lock_arena(ar);
+        for(chunk *ch = &ar->base; ch != NULL; ch = ch->next) {
+            for(void *curr_block = ch->start_block; curr_block < ch->segment_end; curr_block = get_next_block(curr_block)) {
+                size_t size = get_block_size(curr_block);
+                if(check_alloc(curr_block)) {
+                    stats.bytes_used += size;
+                    stats.node_bytes_used[ar->node % STATS_NODES] += size;
+                    continue;
+                }
+                stats.bytes_free += size;
+                stats.node_bytes_free[ar->node % STATS_NODES] += size;
+                stats.free_histogram[stats_bucket(size)] += size;
+                char *start;
+                char *end;
+                if(((*get_hdr(curr_block)).block_size & DECOMMITTED) && trim_range(curr_block, &start, &end)) {
+                    stats.bytes_decommitted += end - start;
+                }
+                stats.largest_free = (size > stats.largest_free) ? size : stats.largest_free;
+            }
+        }
+        stats.nblocks += ar->nblocks;
+        stats.coalesces += ar->coalesces;
+        stats.splits += ar->splits;
+        searches += ar->searches;
+        probes += ar->probes;
+        unlock_arena(ar);
+    }
+    stats.numa_nodes = (numa_nodes != 0) ? numa_nodes : 1;
+    stats.bytes_mmapped = __atomic_load_n(&mmap_bytes, __ATOMIC_RELAXED);
+    size_t nslabs = __atomic_load_n(&slab_count, __ATOMIC_RELAXED);
+    stats.bytes_slabs = ((nslabs < slab_limit) ? nslabs : slab_limit) * SLAB_SIZE;
+    stats.avg_probe_length = (searches != 0) ? (double)probes / searches : 0;
+    
+    pthread_mutex_lock(&counts_lock);
+    stats.mallocs = retired_counts.mallocs;
+    stats.frees = retired_counts.frees;
+    stats.reallocs = retired_counts.reallocs;
+    stats.reallocs_in_place = retired_counts.reallocs_in_place;
+    stats.reallocs_moved = retired_counts.reallocs_moved;
+    for(call_counts *cc = counts_list; cc != NULL; cc = cc->next) {
+        if(cc->generation != heap_generation) {
+            continue;
+        }
+        stats.mallocs += __atomic_load_n(&cc->mallocs, __ATOMIC_RELAXED);
+        stats.frees += __atomic_load_n(&cc->frees, __ATOMIC_RELAXED);
+        stats.reallocs += __atomic_load_n(&cc->reallocs, __ATOMIC_RELAXED);
+        stats.reallocs_in_place += __atomic_load_n(&cc->reallocs_in_place, __ATOMIC_RELAXED);
+        stats.reallocs_moved += __atomic_load_n(&cc->reallocs_moved, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&counts_lock);
+    return stats;
+}
+​
+​
+/* Struct: layout_writer
+ * _____________________
+ * Description: The "layout_writer" struct stages one writev worth of a mydump_layout stream on the stack: the 
+ *              stream header (only before the first chunk), the record of the chunk being walked (until its first 
+ *              flush) and up to LAYOUT_BATCH block records. ok turns false on the first failed write.
+ */
+typedef struct {
+    int fd;
+    bool ok;
+    bool header_pending;
+    bool chunk_pending;
+    layout_header header;
+    layout_chunk chunk;
+    size_t nblocks;
+    layout_block blocks[LAYOUT_BATCH];
+} layout_writer;
+​
+/* Function: layout_flush
+ * ___________________
+ * Parameters:
+ *    - w: layout writer
+ *
+ * Return: N/A
+ *
+ * Description: This function writes whatever w has staged with a single writev (more only when the kernel takes
+ *              part of it), picking up where a short write left off, and empties the staging area.
+ */
+void layout_flush(layout_writer *w) {
+    struct iovec iov[3];
+    int niov = 0;
+    if(w->header_pending) {
+        iov[niov++] = (struct iovec){ &w->header, sizeof(w->header) };
+    }
+    if(w->chunk_pending) {
+        iov[niov++] = (struct iovec){ &w->chunk, sizeof(w->chunk) };
+    }
+    if(w->nblocks != 0) {
+        iov[niov++] = (struct iovec){ w->blocks, w->nblocks * sizeof(layout_block) };
+    }
+    struct iovec *next = iov;
+    while(w->ok && niov > 0) {
+        ssize_t n = writev(w->fd, next, niov);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n <= 0) {
+            w->ok = false;
+            break;
+        }
+        while(niov > 0 && (size_t)n >= next->iov_len) {
+            n -= next->iov_len;
+            next += 1;
+            niov -= 1;
+        }
+        if(niov > 0) {
+            next->iov_base = (char *)next->iov_base + n;
+            next->iov_len -= n;
+        }
+    }
+    w->header_pending = false;
+    w->chunk_pending = false;
+    w->nblocks = 0;
+}
+​
+/* Function: layout_info
+ * ___________________
+ * Parameters:
+ *    - ar: arena the block belongs to (caller holds its lock)
+ *    - block_ptr: pointer to start of block
+ *
+ * Return: the block's layout_block info word (size, size class and LAYOUT_* flags)
+ */
+uint64_t layout_info(arena *ar, void *block_ptr) {
+    size_t size = get_block_size(block_ptr);
+    uint64_t flags;
+    if(check_alloc(block_ptr)) {
+        flags = LAYOUT_ALLOC;
+    } else if(block_ptr == ar->wilderness) {
+        flags = LAYOUT_WILDERNESS;
+    } else {
+        flags = uses_tree(size) ? LAYOUT_TREE : LAYOUT_LISTED;
+    }
+    if(!check_alloc(block_ptr) && ((*get_hdr(block_ptr)).block_size & DECOMMITTED)) {
+        flags |= LAYOUT_TRIMMED;
+    }
+    return ((uint64_t)size << 16) | ((uint64_t)get_class(size) << 8) | flags;
+}
+​
+/* Function: mydump_layout
+ * ___________________
+ * Parameters:
+ *    - fd: file descriptor to stream the snapshot to
+ *
+ * Return: true if the whole snapshot was written, false if a write failed
+ *
+ * Description: This function streams the same block walk validate_heap does in the binary format described in
+ *              explicit_allocator.h: a layout_header, then for each chunk of each arena a layout_chunk followed 
+ *              by one 16-byte layout_block per block until the blocks reach the chunk's end. Records are staged 
+ *              in a layout_writer on the stack and sent with writev every LAYOUT_BATCH blocks, so nothing is 
+ *              allocated however big the heap is. Each arena is walked under its own lock, which means the 
+ *              snapshot is exact per arena while the arenas are read one after another (the same trade mystats 
+ *              makes). Blocks waiting in thread caches, quick lists or remote_frees are allocated as far as their
+ *              arena knows, and show up that way. Slabs and MMAPPED blocks aren't part of the walk.
+ */
+bool mydump_layout(int fd) {
+    layout_writer w = { .fd = fd, .ok = true, .header_pending = true, .chunk_pending = false, .nblocks = 0 };
+    memcpy(w.header.magic, LAYOUT_MAGIC, sizeof(w.header.magic));
+    w.header.version = LAYOUT_VERSION;
+    w.header.payload_align = block_align;
+    w.header.narenas = narenas;
+    w.header.heap_base = (uintptr_t)heap_base;
+    w.header.heap_end = (uintptr_t)heap_end;
+    for(size_t i = 0; i < narenas && w.ok; i++) {
+        arena *ar = &arenas[i];
+        lock_arena(ar);
+        for(chunk *ch = &ar->base; ch != NULL && w.ok; ch = ch->next) {
+            if(w.chunk_pending || w.nblocks != 0) {
+                layout_flush(&w);
+            }
+            w.chunk = (layout_chunk){ i, 0, (uintptr_t)ch->start_block, (uintptr_t)ch->segment_end };
+            w.chunk_pending = true;
+            for(void *block = ch->start_block; block < ch->segment_end && w.ok; block = get_next_block(block)) {
+                if(w.nblocks == LAYOUT_BATCH) {
+                    layout_flush(&w);
+                }
+                w.blocks[w.nblocks++] = (layout_block){ (uint64_t)((char *)block - (char *)ch->start_block), layout_info(ar, block) };
+            }
+        }
+        unlock_arena(ar);
+    }
+    layout_flush(&w);
+    return w.ok;
+}
+​
+​
+//PROFILING:
+//___________
+​
+/* Function: fast_log2
+ * ___________________
+ * Parameters:
+ *    - x: positive number
+ *
+ * Return: log2(x), to within about 0.005
+ *
+ * Description: The exponent comes straight out of the double's bits and log2 of the mantissa (in [1, 2)) from a
+ *              quadratic fit, which is plenty for drawing sample gaps and keeps the allocator off libm.
+ */
+double fast_log2(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int exponent = (int)((bits >> 52) & 0x7FF) - 1023;
+    bits = (bits & ~(0x7FFUL << 52)) | (1023UL << 52);
+    double m;
+    memcpy(&m, &bits, sizeof(m));
+    return exponent + (-0.34484843 * m + 2.02466578) * m - 1.67487759;
+}
+​
+/* Function: next_sample_gap
+ * ___________________
+ * Parameters:
+ *    - interval: mean number of bytes between samples
+ *
+ * Return: number of bytes the calling thread allocates before its next sample
+ *
+ * Description: Gaps are drawn from an exponential distribution with mean interval (-ln(u) * interval for u 
+ *              uniform in (0, 1]), the same scheme tcmalloc and jemalloc use. Sampling is then a Poisson process 
+ *              over allocated bytes, so a block of size s is sampled with probability 1 - exp(-s / interval), 
+ *              which is the weighting pprof undoes for heap_v2 profiles.
+ */
+size_t next_sample_gap(size_t interval) {
+    uint64_t x = (sample_seed != 0) ? sample_seed : ((uintptr_t)&sample_seed * 0x9E3779B97F4A7C15UL) | 1;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    sample_seed = x;
+    double u = (double)((x >> 11) + 1) / (double)(1UL << 53);
+    double gap = -fast_log2(u) * 0.6931471805599453 * (double)interval;
+    return (gap > 0) ? (size_t)gap + 1 : 1;
+}
+​
+/* Function: profile_slot
+ * ___________________
+ * Parameters:
+ *    - ptr: block pointer
+ *
+ * Return: index of the first slot of ptr's probe sequence in profile_table
+ */
+size_t profile_slot(void *ptr) {
+    return (size_t)(((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15UL >> 49) & (PROFILE_SLOTS - 1);
+}
+​
+/* Function: profile_find
+ * ___________________
+ * Parameters:
+ *    - ptr: block pointer
+ *
+ * Return: ptr's slot in profile_table, NULL if ptr isn't a sampled block
+ *
+ * Description: This function looks at up to PROFILE_PROBES slots from ptr's home slot, stopping at the first 
+ *              never-used one. It is safe without profile_lock because a block can only be in the table while
+ *              it is live, so no other thread adds or removes ptr itself while its owner is freeing it.
+ */
+heap_sample *profile_find(void *ptr) {
+    size_t slot = profile_slot(ptr);
+    for(int i = 0; i < PROFILE_PROBES; i++) {
+        heap_sample *sample = &profile_table[(slot + i) & (PROFILE_SLOTS - 1)];
+        void *key = __atomic_load_n(&sample->ptr, __ATOMIC_ACQUIRE);
+        if(key == ptr) {
+            return sample;
+        }
+        if(key == NULL) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+​
+/* Function: profile_insert
+ * ___________________
+ * Parameters:
+ *    - ptr: block pointer (not already in the table)
+ *    - size: requested size
+ *    - stack / depth: return addresses of the allocating call
+ *
+ * Return: N/A
+ *
+ * Description: This function takes the first unused or tombstoned slot in ptr's probe sequence (caller holds 
+ *              profile_lock). The key is stored last, with a release store, so an unlocked profile_find never 
+ *              sees half a sample. A sample with nowhere to go is counted in profile_dropped.
+ */
+void profile_insert(void *ptr, size_t size, void **stack, int depth) {
+    size_t slot = profile_slot(ptr);
+    for(int i = 0; i < PROFILE_PROBES; i++) {
+        heap_sample *sample = &profile_table[(slot + i) & (PROFILE_SLOTS - 1)];
+        if(sample->ptr == NULL || sample->ptr == PROFILE_TOMBSTONE) {
+            sample->size = size;
+            sample->depth = depth;
+            memmove(sample->stack, stack, depth * sizeof(void *));
+            __atomic_store_n(&sample->ptr, ptr, __ATOMIC_RELEASE);
+            __atomic_store_n(&profile_live, profile_live + 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    profile_dropped += 1;
+}
+​
+/* Function: profile_sample
+ * ___________________
+ * Parameters:
+ *    - ptr: block just allocated (or NULL if the allocation failed)
+ *    - size: requested size
+ *
+ * Return: ptr
+ *
+ * Description: This is the slow path mymalloc and mycalloc take once the thread's sample_left runs out. It draws
+ *              the next gap and records ptr with a backtrace (skipping the allocator's own frames). While the 
+ *              profiler is off, sample_left is just reset to PROFILE_RECHECK, so a thread notices myprofile_start
+ *              within that many bytes. in_profile keeps the allocations backtrace makes on its first call (when
+ *              the unwinder is loaded) from being sampled in turn.
+ */
+void *profile_sample(void *ptr, size_t size) {
+    size_t interval = __atomic_load_n(&profile_interval, __ATOMIC_RELAXED);
+    if(interval == 0) {
+        sample_left = PROFILE_RECHECK;
+        return ptr;
+    }
+    sample_left = next_sample_gap(interval);
+    if(ptr == NULL || in_profile) {
+        return ptr;
+    }
+    in_profile = true;
+    void *stack[PROFILE_DEPTH + 2];
+    int depth = backtrace(stack, PROFILE_DEPTH + 2) - 2;
+    pthread_mutex_lock(&profile_lock);
+    profile_insert(ptr, size, stack + 2, (depth > 0) ? depth : 0);
+    pthread_mutex_unlock(&profile_lock);
+    in_profile = false;
+    return ptr;
+}
+​
+/* Function: profile_grow
+ * ___________________
+ * Parameters:
+ *    - old_ptr: block passed to myrealloc
+ *    - new_ptr: the same block after growing where it was (or sliding left, or being moved by mremap)
+ *    - grown: number of bytes it grew by
+ *    - new_size: size it was resized to
+ *
+ * Return: new_ptr
+ *
+ * Description: resize_block calls this when a block grew without going through mymalloc, so that the growth 
+ *              counts down sample_left like a fresh allocation would. A block that already has a sample keeps
+ *              it (profile_moved updates it afterwards) and only draws the next gap.
+ */
+void *profile_grow(void *old_ptr, void *new_ptr, size_t grown, size_t new_size) {
+    if(grown < sample_left) {
+        sample_left -= grown;
+        return new_ptr;
+    }
+    bool sampled = __atomic_load_n(&profile_live, __ATOMIC_RELAXED) != 0 && profile_find(old_ptr) != NULL;
+    profile_sample(sampled ? NULL : new_ptr, new_size);
+    return new_ptr;
+}
+​
+/* Function: profile_forget
+ * ___________________
+ * Parameters:
+ *    - ptr: block being freed
+ *
+ * Return: N/A
+ *
+ * Description: The free paths call this whenever profile_live is non-zero. Blocks that weren't sampled (nearly 
+ *              all of them) are turned away by profile_find without taking profile_lock.
+ */
+void profile_forget(void *ptr) {
+    heap_sample *sample = profile_find(ptr);
+    if(sample == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&profile_lock);
+    if(sample->ptr == ptr) {
+        __atomic_store_n(&sample->ptr, PROFILE_TOMBSTONE, __ATOMIC_RELEASE);
+        __atomic_store_n(&profile_live, profile_live - 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+​
+/* Function: profile_moved
+ * ___________________
+ * Parameters:
+ *    - old_ptr: block passed to myrealloc
+ *    - new_ptr: block myrealloc returned
+ *    - new_size: size it was resized to
+ *
+ * Return: N/A
+ *
+ * Description: A sampled block resized in place keeps its sample with the new size, and one moved by mremap
+ *              has its sample moved along with it. Blocks moved through mymalloc and myfree were already 
+ *              forgotten by the free.
+ */
+void profile_moved(void *old_ptr, void *new_ptr, size_t new_size) {
+    heap_sample *sample = profile_find(old_ptr);
+    if(sample == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&profile_lock);
+    if(sample->ptr == old_ptr) {
+        if(new_ptr == old_ptr) {
+            sample->size = new_size;
+        } else {
+            __atomic_store_n(&sample->ptr, PROFILE_TOMBSTONE, __ATOMIC_RELEASE);
+            __atomic_store_n(&profile_live, profile_live - 1, __ATOMIC_RELAXED);
+            profile_insert(new_ptr, new_size, sample->stack, sample->depth);
+        }
+    }
+    pthread_mutex_unlock(&profile_lock);
+}
+​
+/* Function: profile_reset
+ * ___________________
+ * Return: N/A
+ *
+ * Description: myinit_config calls this to drop the samples of the previous heap. Giving the table's pages back
+ *              with MADV_DONTNEED empties every slot without touching them.
+ */
+void profile_reset(void) {
+    if(profile_table != NULL) {
+        madvise(profile_table, PROFILE_SLOTS * sizeof(heap_sample), MADV_DONTNEED);
+        profile_live = 0;
+        profile_dropped = 0;
+    }
+}
+​
+/* Function: myprofile_start
+ * ___________________
+ * Parameters:
+ *    - sample_bytes: mean number of bytes allocated between two samples (512 KB is what tcmalloc uses)
+ *
+ * Return: true if the profiler is now running, false if sample_bytes is 0 or the table couldn't be mapped
+ *
+ * Description: This function maps profile_table on first use and sets the sampling interval. The calling thread
+ *              draws its first gap right away; other threads pick up the new interval the next time their 
+ *              current gap runs out, which is within PROFILE_RECHECK bytes if the profiler was off. Calling it
+ *              again while running just changes the interval.
+ */
+bool myprofile_start(size_t sample_bytes) {
+    if(sample_bytes == 0) {
+        return false;
+    }
+    pthread_mutex_lock(&profile_lock);
+    if(profile_table == NULL) {
+        void *map = mmap(NULL, PROFILE_SLOTS * sizeof(heap_sample), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        profile_table = (map != MAP_FAILED) ? map : NULL;
+    }
+    if(profile_table != NULL) {
+        __atomic_store_n(&profile_interval, sample_bytes, __ATOMIC_RELAXED);
+        sample_left = next_sample_gap(sample_bytes);
+    }
+    pthread_mutex_unlock(&profile_lock);
+    return profile_table != NULL;
+}
+​
+/* Function: myprofile_stop
+ * ___________________
+ * Return: N/A
+ *
+ * Description: This function stops taking new samples. Samples of blocks that are still live stay in the table
+ *              (and in later dumps) until those blocks are freed.
+ */
+void myprofile_stop(void) {
+    __atomic_store_n(&profile_interval, 0, __ATOMIC_RELAXED);
+}
+​
+/* Struct: dump_buffer
+ * ___________________
+ * Description: The "dump_buffer" struct collects the text of a profile in a fixed buffer on the stack and 
+ *              writes it to fd whenever it fills up, so dumping never allocates. ok turns false on the first 
+ *              failed write.
+ */
+typedef struct {
+    int fd;
+    bool ok;
+    size_t len;
+    char data[4096];
+} dump_buffer;
+​
+/* Function: dump_flush
+ * ___________________
+ * Parameters:
+ *    - buf: dump buffer
+ *
+ * Return: N/A
+ *
+ * Description: This function writes out everything in buf (retrying short and interrupted writes) and empties it.
+ */
+void dump_flush(dump_buffer *buf) {
+    size_t done = 0;
+    while(buf->ok && done < buf->len) {
+        ssize_t n = write(buf->fd, buf->data + done, buf->len - done);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        buf->ok = (n > 0);
+        done += (n > 0) ? n : 0;
+    }
+    buf->len = 0;
+}
+​
+/* Function: dump_text
+ * ___________________
+ * Parameters:
+ *    - buf: dump buffer
+ *    - text: bytes to append
+ *    - len: number of bytes
+ *
+ * Return: N/A
+ */
+void dump_text(dump_buffer *buf, const char *text, size_t len) {
+    while(len > 0) {
+        if(buf->len == sizeof(buf->data)) {
+            dump_flush(buf);
+        }
+        size_t n = (len < sizeof(buf->data) - buf->len) ? len : sizeof(buf->data) - buf->len;
+        memcpy(buf->data + buf->len, text, n);
+        buf->len += n;
+        text += n;
+        len -= n;
+    }
+}
+​
+/* Function: myprofile_dump
+ * ___________________
+ * Parameters:
+ *    - fd: file descriptor to write the profile to
+ *
+ * Return: true if the whole profile was written, false if a write failed or the profiler was never started
+ *
+ * Description: This function writes the live samples as a legacy text heap profile that pprof reads directly 
+ *              ("pprof --text program heap.prof"): a header line with the totals and the sampling interval 
+ *              (heap_v2 format, so pprof scales the samples back up to estimated live bytes), one line per 
+ *              sampled block with its size and call stack, and a copy of /proc/self/maps so pprof can symbolize
+ *              addresses in shared libraries. profile_lock is held throughout, which only holds up allocations
+ *              that are being sampled and frees of sampled blocks.
+ */
+bool myprofile_dump(int fd) {
+    if(profile_table == NULL) {
+        return false;
+    }
+    dump_buffer buf = { .fd = fd, .ok = true, .len = 0 };
+    char line[160];
+    pthread_mutex_lock(&profile_lock);
+    size_t count = 0;
+    size_t bytes = 0;
+    for(size_t i = 0; i < PROFILE_SLOTS; i++) {
+        if(profile_table[i].ptr != NULL && profile_table[i].ptr != PROFILE_TOMBSTONE) {
+            count += 1;
+            bytes += profile_table[i].size;
+        }
+    }
+    int len = snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n", count, bytes, count, bytes, (profile_interval != 0) ? profile_interval : 1);
+    dump_text(&buf, line, len);
+    for(size_t i = 0; i < PROFILE_SLOTS; i++) {
+        heap_sample *sample = &profile_table[i];
+        if(sample->ptr == NULL || sample->ptr == PROFILE_TOMBSTONE) {
+            continue;
+        }
+        len = snprintf(line, sizeof(line), "1: %zu [1: %zu] @", sample->size, sample->size);
+        dump_text(&buf, line, len);
+        for(int d = 0; d < sample->depth; d++) {
+            len = snprintf(line, sizeof(line), " %p", sample->stack[d]);
+            dump_text(&buf, line, len);
+        }
+        dump_text(&buf, "\n", 1);
+    }
+    pthread_mutex_unlock(&profile_lock);
+    
+    dump_text(&buf, "\nMAPPED_LIBRARIES:\n", 19);
+    int maps = open("/proc/self/maps", O_RDONLY);
+    if(maps >= 0) {
+        ssize_t n;
+        while((n = read(maps, line, sizeof(line))) > 0) {
+            dump_text(&buf, line, n);
+        }
+        close(maps);
+    }
+    dump_flush(&buf);
+    return buf.ok;
+}
+​
+​
+//ALLOCATOR FUNCTIONS:
+//____________________
+​
+​
+/* Function: myinit_config
+ * ___________________
+ * Parameters:
+ *    - heap_start: start of heap segment
+ *    - heap_size: size of heap segment
+ *    - config: allocator options (NULL for the defaults, see explicit_allocator.h)
+ *
+ * Return: true if segment available for use, false otherwise
+ *
+ * Description: This function splits the segment into config->narenas equal slices (the last one takes the remainder)
+ *              and initializes each as an independent arena (trimming each slice's ends so its payloads land on
+ *              block_align), unmapping any memory the previous heap grew into. With numa_arenas, arena i's slice 
+ *              is bound to node i % numa_nodes. With huge_pages, the whole huge
+ *              pages inside the segment are marked MADV_HUGEPAGE. It also bumps heap_generation so every thread's
+ *              cache is reset on its next use.
+ */
+bool myinit_config(void *heap_start, size_t heap_size, const allocator_config *config) {
+    size_t count = (config != NULL && config->narenas > 1) ? config->narenas : 1;
+    size_t span = (heap_size / count) & ~(WIDTH - 1);
+#ifdef HEAP_FIT_POLICY
+    int policy = HEAP_FIT_POLICY;
+#else
+    int policy = (config != NULL) ? config->fit_policy : FIT_FIRST;
+#endif
+#ifdef HEAP_COMPACT_LINKS
+    bool compact = HEAP_COMPACT_LINKS;
+#else
+    bool compact = (config != NULL) && config->compact_links;
+#endif
+#ifdef HEAP_ALIGN
+    size_t align = HEAP_ALIGN;
+#else
+    size_t align = (config != NULL && config->default_alignment != 0) ? config->default_alignment : WIDTH;
+#endif
+    if(count > MAX_ARENAS || (policy != FIT_FIRST && policy != FIT_BEST && policy != FIT_ADDRESS) || (align != WIDTH && align != 2 * WIDTH)) {
+        return false;
+    }
+    if(span < sizeof(header) + WIDTH + 2 * (align - WIDTH)) {
+        return false;
+    }
+    if(compact && heap_size > COMPACT_SPAN) {
+        return false;
+    }
+    
+    unmap_regions();
+    profile_reset();
+    huge_pages = (config != NULL) && config->huge_pages;
+    if(!init_slabs((config != NULL) ? config->slab_region_size : 0)) {
+        return false;
+    }
+    page_size = sysconf(_SC_PAGESIZE);
+    trim_granule = huge_pages ? HUGE_PAGE_SIZE : page_size;
+#ifdef MADV_HUGEPAGE
+    char *huge_start = (char *)(((uintptr_t)heap_start + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    char *huge_end = (char *)(((uintptr_t)heap_start + heap_size) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if(huge_pages && huge_end > huge_start) {
+        madvise(huge_start, huge_end - huge_start, MADV_HUGEPAGE);
+    }
+#endif
+    mmap_threshold = (config != NULL) ? config->mmap_threshold : 0;
+    check_interval = (config != NULL) ? config->check_interval : 0;
+#ifndef HEAP_FIT_POLICY
+    fit_policy = policy;
+#endif
+#ifndef HEAP_DEFER_COALESCE
+    defer_coalesce = (config != NULL) && config->defer_coalesce;
+#endif
+#ifndef HEAP_COMPACT_LINKS
+    compact_links = compact;
+#endif
+#ifndef HEAP_ALIGN
+    block_align = align;
+#endif
+    min_block = ((compact ? COMPACT_MIN_SIZE : MIN_SIZE) + WIDTH + align - 1) & ~(align - 1);
+    min_size = min_block - WIDTH;
+    heap_base = heap_start;
+    heap_end = (char *)heap_start + heap_size;
+    narenas = count;
+    arena_span = span;
+    arena_select = (config != NULL) ? config->arena_select : ARENA_ROUND_ROBIN;
+    numa_nodes = 0;
+    if(config != NULL && config->numa_arenas) {
+        size_t nodes = load_numa_topology();
+        numa_nodes = (nodes < count) ? nodes : count;
+    }
+    for(size_t i = 0; i < count; i++) {
+        char *start = (char *)heap_start + i * span;
+        char *end = (i == count - 1) ? (char *)heap_end : start + span;
+        start = (char *)((((uintptr_t)start + WIDTH + align - 1) & ~(uintptr_t)(align - 1)) - WIDTH);
+        end = (char *)((uintptr_t)end & ~(uintptr_t)(align - 1));
+        init_arena(&arenas[i], start, end - start, (config != NULL) ? config->grow_size : 0, (config != NULL) && config->segment_zeroed);
+        arenas[i].node = (numa_nodes != 0) ? i % numa_nodes : 0;
+        if(numa_nodes != 0) {
+            bind_to_node(start, end - start, arenas[i].node);
+        }
+    }
+    pthread_mutex_lock(&counts_lock);
+    memset(&retired_counts, 0, sizeof(retired_counts));
+    heap_generation += 1;
+    pthread_mutex_unlock(&counts_lock);
+    return true;
+}
+​
+/* Function: myinit
+ * ___________________
+ * Parameters:
+ *    - heap_start: start of heap segment
+ *    - heap_size: size of heap segment
+ *
+ * Return: true if segment available for use, false otherwise
+ *
+ * Description: This function initializes the heap as a single arena covering the whole segment.
+ */
+bool myinit(void *heap_start, size_t heap_size) {
+    return myinit_config(heap_start, heap_size, NULL);
+}
+​
+/* Function: malloc_block
+ * ___________________
+ * Parameters:
+ *    - req_size: requested block size
+ *
+ * Return: pointer to newly allocated block, NULL if out of memory or req_size is 0 or over MAX_REQUEST
+ *
+ * Description: This is mymalloc minus the profiler's countdown. Requests of up to SLAB_MAX bytes take a slab slot when
+ *              slabs are enabled (falling through to the rest of this function once the slab range is used up).
+ *              Requests of at least mmap_threshold bytes (when set) get their own mapping. Requests of up to TCACHE_MAX
+ *              bytes are served from the calling thread's cache without any locking. When the bin is empty,
+ *              tcache_refill pulls a batch from the thread's home arena under one lock acquisition. Everything else
+ *              goes straight to the home arena through arena_malloc.
+ */
+void *malloc_block(size_t req_size) {
+    if(req_size <= 0 || req_size > MAX_REQUEST) {
+        return NULL;
+    }
+    count(&get_counts()->mallocs);
+    
+    if(req_size <= SLAB_MAX && slab_limit != 0) {
+        void *slot = slab_alloc(req_size);
+        if(slot != NULL) {
+            return slot;
+        }
+    }
+    size_t size = round_up(req_size);
+    if(mmap_threshold != 0 && size >= mmap_threshold) {
+        return mmap_alloc(size);
+    }
+    tcache *tc = get_tcache();
+    if(size <= TCACHE_MAX) {
+        int bin = get_tcache_bin(size);
+        void *block = tc->bins[bin];
+        if(block == NULL) {
+            return tcache_refill(tc, size);
+        }
+        tc->bins[bin] = *(void **)block;
+        tc->counts[bin] -= 1;
+        return block;
+    }
+    return arena_malloc(home_arena(tc), size, 0, false);
+}
+​
+/* Function: mymalloc
+ * ___________________
+ * Parameters:
+ *    - req_size: requested block size
  *
- * Return: N/A
+ * Return: pointer to newly allocated block, NULL if out of memory or req_size is 0 or over MAX_REQUEST
  *
- * Description: This function fulfills reallocation requests. If the request will shrink the block, there are two cases. The
- *              implicit case is that the difference in size between the reallocated block and original block is less than the
- *              size of a header (24 bytes including pointers). In this case, nothing changes, as the remaining space is treated
- *              as padding. If the size difference >= 24 bytes, the remaining space added as a block to the free list. For expand
- *              requests, right search is used to determine if in-place realloc is possible. If so, the blocks size is updated and
- *              the pointers of the free blocks being allocated are arranged by fix_neighbors. Otherwise, normal realloc occurs and
- *              moves the block somewhere else in memory.
+ * Description: This function allocates with malloc_block. Every requested byte counts down the thread's 
+ *              sample_left, and the allocation that runs it out goes through profile_sample, so an unsampled 
+ *              call only pays one compare and one subtraction whether or not the profiler is running.
  */
-void *myrealloc(void *old_ptr, size_t new_size) {
-    if(old_ptr == NULL) {
-        return mymalloc(new_size);
+void *mymalloc(size_t req_size) {
+    if(req_size >= sample_left) {
+        return profile_sample(malloc_block(req_size), req_size);
     }
-    if(new_size == 0) {
-        myfree(old_ptr);
+    sample_left -= req_size;
+    return malloc_block(req_size);
+}
+​
+/* Function: myaligned_alloc
+ * ___________________
+ * Parameters:
+ *    - alignment: required alignment of the returned pointer (a power of two)
+ *    - req_size: requested block size
+ *
+ * Return: pointer to a block of at least req_size bytes at a multiple of alignment, NULL if alignment isn't a 
+ *         power of two or the heap is out of memory
+ *
+ * Description: Alignments the heap already guarantees (block_align) are plain mymalloc calls. Anything stricter 
+ *              goes to the arenas through heap_aligned, skipping the slabs, the mmap path and the thread cache 
+ *              since none of them can place a payload on an arbitrary boundary. The block is an ordinary arena 
+ *              block afterwards, so myfree and myrealloc treat it like any other (a moved realloc only keeps 
+ *              block_align). The bytes count toward the profiler's sample_left like mymalloc's.
+ */
+void *myaligned_alloc(size_t alignment, size_t req_size) {
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
         return NULL;
     }
-    
-    size_t curr_size = get_block_size(old_ptr);
-    new_size = round_up(new_size);
+    if(alignment <= block_align) {
+        return mymalloc(req_size);
+    }
+    if(req_size == 0 || req_size > MAX_REQUEST) {
+        return NULL;
+    }
+    count(&get_counts()->mallocs);
+    void *block = arena_malloc(home_arena(get_tcache()), round_up(req_size), alignment, false);
+    if(req_size >= sample_left) {
+        return profile_sample(block, req_size);
+    }
+    sample_left -= req_size;
+    return block;
+}
 ​
-    if(curr_size >= new_size) { //SHRINK
-        size_t size_diff = curr_size - new_size;
-        
-        if (size_diff >= sizeof(header)) {
-            void *new_free_start = (char *)old_ptr + new_size + WIDTH;
-            set_hdr_size(old_ptr, new_size);
-            change_to_free(new_free_start);
-            set_hdr_size(new_free_start, size_diff - WIDTH);
-            nblocks += 1;
+/* Function: myposix_memalign
+ * ___________________
+ * Parameters:
+ *    - memptr: where to store the new block
+ *    - alignment: required alignment (a power of two and a multiple of sizeof(void *))
+ *    - req_size: requested block size
+ *
+ * Return: 0 on success, EINVAL for a bad alignment, ENOMEM if the heap is out of memory
+ *
+ * Description: This function is the posix_memalign flavor of myaligned_alloc. *memptr is only written on success.
+ */
+int myposix_memalign(void **memptr, size_t alignment, size_t req_size) {
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0 || alignment % sizeof(void *) != 0) {
+        return EINVAL;
+    }
+    void *block = myaligned_alloc(alignment, (req_size != 0) ? req_size : 1);
+    if(block == NULL) {
+        return ENOMEM;
+    }
+    *memptr = block;
+    return 0;
+}
+​
+/* Function: mycalloc
+ * ___________________
+ * Parameters:
+ *    - nmemb: number of elements
+ *    - req_size: size of each element
+ *
+ * Return: pointer to nmemb * req_size zeroed bytes, NULL if the product is 0 or overflows, or if out of memory
+ *
+ * Description: Requests for the mmap path get a fresh mapping, which is already zero. Requests small enough for 
+ *              the thread cache (or a slab) go through mymalloc and a memset, since those blocks have just been
+ *              used. Everything else is allocated from the arenas with heap_calloc, which skips the pages it knows
+ *              are zero: a never-touched wilderness (after grow_arena, or with segment_zeroed), and free blocks 
+ *              mytrim gave back to the kernel. The bytes count toward the profiler's sample_left like mymalloc's.
+ */
+void *mycalloc(size_t nmemb, size_t req_size) {
+    if(req_size != 0 && nmemb > SIZE_MAX / req_size) {
+        return NULL;
+    }
+    size_t total = nmemb * req_size;
+    if(total == 0 || total > MAX_REQUEST) {
+        return NULL;
+    }
+    void *block;
+    size_t size = round_up(total);
+    if(size <= TCACHE_MAX) {
+        block = malloc_block(total);
+        if(block != NULL) {
+            memset(block, 0, total);
         }
-        return old_ptr;
-        
-    } else { //EXPAND
-        size_t size_diff = new_size - curr_size;
-        int r_free_blocks = right_search((char *)old_ptr + curr_size + WIDTH, size_diff);
-        
-        if (r_free_blocks) {
-            fix_neighbors(get_next_block(old_ptr), &new_size, r_free_blocks, size_diff);
-            set_hdr_size(old_ptr, new_size);
-            return old_ptr;
+    } else {
+        count(&get_counts()->mallocs);
+        block = (mmap_threshold != 0 && size >= mmap_threshold) ? mmap_alloc(size) : arena_malloc(home_arena(get_tcache()), size, 0, true);
+    }
+    if(total >= sample_left) {
+        return profile_sample(block, total);
+    }
+    sample_left -= total;
+    return block;
+}
+​
+/* Function: mymalloc_onnode
+ * ___________________
+ * Parameters:
+ *    - req_size: requested block size
+ *    - node: NUMA node the block should live on
+ *
+ * Return: pointer to newly allocated block, NULL if out of memory, req_size is 0 or node is out of range
+ *
+ * Description: This function allocates from the arenas placed on node, skipping the slabs and the thread cache
+ *              (whose blocks may come from any node). Requests for the mmap path get their own mapping bound to 
+ *              node. If none of the node's arenas has room, the request goes to arena_malloc starting from the 
+ *              node's first arena, which grows that arena (on node) once every other arena is full too. Without
+ *              numa_arenas there is only node 0 and this is a plain arena allocation. The bytes count toward 
+ *              the profiler's sample_left like mymalloc's.
+ */
+void *mymalloc_onnode(size_t req_size, int node) {
+    size_t nodes = (numa_nodes != 0) ? numa_nodes : 1;
+    if(req_size == 0 || req_size > MAX_REQUEST || node < 0 || (size_t)node >= nodes) {
+        return NULL;
+    }
+    count(&get_counts()->mallocs);
+    size_t size = round_up(req_size);
+    void *block = NULL;
+    if(mmap_threshold != 0 && size >= mmap_threshold) {
+        block = mmap_alloc(size);
+        if(block != NULL && numa_nodes != 0) {
+            bind_to_node(mmap_start(block), get_block_size(block) + block_align, node);
+        }
+    } else if(numa_nodes == 0) {
+        block = arena_malloc(home_arena(get_tcache()), size, 0, false);
+    } else {
+        for(size_t i = node; i < narenas && block == NULL; i += numa_nodes) {
+            lock_arena(&arenas[i]);
+            remote_drain(&arenas[i]);
+            block = heap_malloc(&arenas[i], size);
+            unlock_arena(&arenas[i]);
+        }
+        if(block == NULL) {
+            block = arena_malloc(&arenas[node], size, 0, false);
+        }
+    }
+    if(req_size >= sample_left) {
+        return profile_sample(block, req_size);
+    }
+    sample_left -= req_size;
+    return block;
+}
+​
+/* Function: mymalloc_batch
+ * ___________________
+ * Parameters:
+ *    - req_size: requested size of each block
+ *    - count: number of blocks wanted
+ *    - out: array of at least count pointers that receives the blocks
+ *
+ * Return: number of blocks allocated (fewer than count only when the heap runs out of memory)
+ *
+ * Description: This function takes the home arena's lock once and carves the blocks back to back out of as few 
+ *              free blocks as possible (heap_malloc_batch). Each block is an ordinary allocation that can be freed
+ *              with myfree or myfree_batch. Requests for the mmap path, and whatever the home arena couldn't fit,
+ *              go through mymalloc one block at a time. Every block counts toward the profiler's sample_left.
+ */
+size_t mymalloc_batch(size_t req_size, size_t count, void **out) {
+    if(req_size == 0 || req_size > MAX_REQUEST || count == 0) {
+        return 0;
+    }
+    size_t size = round_up(req_size);
+    size_t done = 0;
+    if(mmap_threshold == 0 || size < mmap_threshold) {
+        arena *ar = home_arena(get_tcache());
+        lock_arena(ar);
+        remote_drain(ar);
+        done = heap_malloc_batch(ar, size, count, out);
+        unlock_arena(ar);
+        count_many(&get_counts()->mallocs, done);
+    }
+    for(size_t i = 0; i < done; i++) {
+        if(req_size >= sample_left) {
+            profile_sample(out[i], req_size);
         } else {
-            void *new_ptr = mymalloc(new_size);
-            memcpy(new_ptr, old_ptr, new_size);
-            myfree(old_ptr);
-            return new_ptr;
+            sample_left -= req_size;
         }
     }
-    return NULL;
+    for(; done < count; done++) {
+        if((out[done] = mymalloc(req_size)) == NULL) {
+            break;
+        }
+    }
+    return done;
 }
 ​
-bool validate_heap() {
-    void *curr_block = start_block;
-    size_t used_bytes = 0;
-    size_t free_bytes = 0;
-    int free_count = 0;
-    int n_free = nblocks - nused;
+/* Function: myfree
+ * ___________________
+ * Parameters:
+ *    - ptr: pointer to block to be freed
+ *
+ * Return: N/A
+ *
+ * Description: Slab slots (recognized by address) go back to their slab. MMAPPED blocks are unmapped. Blocks of up
+ *              to TCACHE_MAX bytes are pushed onto the calling thread's cache (draining a batch back to the arenas
+ *              first if the bin is full). Larger blocks are freed and coalesced in their own arena (the one the address
+ *              falls in, whichever thread allocated them) with arena_free, which hands them to the arena's remote_frees
+ *              stack when it isn't the calling thread's home. With check_interval set, an arena block is first run
+ *              through check_freed once every check_interval frees on average. While the profiler holds samples, the
+ *              block's sample (if it has one) is dropped.
+ */
+void myfree(void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    count(&get_counts()->frees);
+    if(__atomic_load_n(&profile_live, __ATOMIC_RELAXED) != 0) {
+        profile_forget(ptr);
+    }
+    if(in_slab_range(ptr)) {
+        slab_free(ptr);
+        return;
+    }
     
-    for(int i = 0; i < nblocks; i++) {
-        size_t block_width_size = get_block_size(curr_block) + WIDTH;
-        if(check_alloc(curr_block)) {
-            used_bytes += block_width_size;
-        } else {
-            free_count += 1;
-            free_bytes += block_width_size;
+    size_t hdr_word = __atomic_load_n(&(*get_hdr(ptr)).block_size, __ATOMIC_RELAXED);
+    size_t size = (hdr_word & ~FLAG_MASK) >> 2;
+    if(hdr_word & MMAPPED) {
+        mmap_free(ptr);
+        return;
+    }
+    tcache *tc = get_tcache();
+    if(check_interval != 0 && --tc->check_countdown == 0) {
+        tc->check_countdown = next_check(tc);
+        check_freed(ptr);
+    }
+    if(size <= TCACHE_MAX) {
+        if(tc->counts[get_tcache_bin(size)] == TCACHE_COUNT) {
+            tcache_drain(tc, get_tcache_bin(size), TCACHE_BATCH);
         }
-        curr_block = get_next_block(curr_block);
+        tcache_push(tc, ptr, size);
+        return;
     }
+    
+    arena_free(tc, ptr);
+}
 ​
-    if(used_bytes + free_bytes != segment_size) {
-        return false;
+#ifdef DEBUG
+/* Function: sized_matches
+ * ___________________
+ * Parameters:
+ *    - ptr: block passed to myfree_sized
+ *    - req_size: size the caller passed with it
+ *
+ * Return: true if the block could have been allocated (or last reallocated) with req_size bytes
+ *
+ * Description: This checks what myfree_sized's fast path relies on. A slab slot must be the slot req_size
+ *              rounds to. An MMAPPED block must be at least req_size bytes and req_size must reach mmap_threshold,
+ *              since smaller sizes are routed to the thread cache unseen. Any other block must be at least the
+ *              rounded size and less than min_block bytes bigger (plus grow_reserve's headroom for sizes a realloc
+ *              may have reserved it for), so that the bin the size picks still serves the block.
+ */
+bool sized_matches(void *ptr, size_t req_size) {
+    if(in_slab_range(ptr)) {
+        return ((req_size + block_align - 1) & ~(block_align - 1)) == (*slab_of(ptr)).slot_size;
     }
-    if(free_count != n_free) {
-        return false;
+    size_t size = round_up(req_size);
+    size_t block_size = get_block_size(ptr);
+    if((*get_hdr(ptr)).block_size & MMAPPED) {
+        return mmap_threshold != 0 && size >= mmap_threshold && block_size >= size;
+    }
+    return block_size >= size && block_size - size < min_block + (grow_reserve(size) - size);
+}
+#endif
+​
+/* Function: myfree_sized
+ * ___________________
+ * Parameters:
+ *    - ptr: pointer to block to be freed
+ *    - req_size: size the block was allocated (or last reallocated) with
+ *
+ * Return: N/A
+ *
+ * Description: This function frees ptr like myfree, but uses req_size to route it. Sizes below mmap_threshold 
+ *              can't belong to an MMAPPED block, so blocks that fit the thread cache are pushed onto their bin 
+ *              without loading the header (a block is never more than min_block bytes bigger than its rounded 
+ *              size, so the bin it lands in still serves it). Slab slots are recognized by address as usual, and 
+ *              everything else goes through myfree, which needs the header anyway to coalesce or unmap. Building
+ *              with DEBUG defined checks req_size against the header and reports a mismatch on stderr before
+ *              falling back to myfree.
+ */
+void myfree_sized(void *ptr, size_t req_size) {
+    if(ptr == NULL) {
+        return;
+    }
+#ifdef DEBUG
+    if(!sized_matches(ptr, req_size)) {
+        fprintf(stderr, "myfree_sized: %zu bytes doesn't match the size of block %p\n", req_size, ptr);
+        myfree(ptr);
+        return;
+    }
+#endif
+    size_t size = round_up(req_size);
+    if(in_slab_range(ptr) || size > TCACHE_MAX || (mmap_threshold != 0 && size >= mmap_threshold)) {
+        myfree(ptr);
+        return;
+    }
+    count(&get_counts()->frees);
+    if(__atomic_load_n(&profile_live, __ATOMIC_RELAXED) != 0) {
+        profile_forget(ptr);
+    }
+    tcache *tc = get_tcache();
+    if(check_interval != 0 && --tc->check_countdown == 0) {
+        tc->check_countdown = next_check(tc);
+        check_freed(ptr);
+    }
+    if(tc->counts[get_tcache_bin(size)] == TCACHE_COUNT) {
+        tcache_drain(tc, get_tcache_bin(size), TCACHE_BATCH);
+    }
+    tcache_push(tc, ptr, size);
+}
+​
+/* Function: myusable_size
+ * ___________________
+ * Parameters:
+ *    - ptr: allocated block (or NULL)
+ *
+ * Return: number of bytes the caller may use at ptr, 0 for NULL
+ *
+ * Description: This is the whole payload: the slot size for a slab slot, the rest of the mapping for an MMAPPED
+ *              block and the block size otherwise (allocated blocks carry no footer), so it is at least the size 
+ *              the block was requested with and often a little more.
+ */
+size_t myusable_size(void *ptr) {
+    if(ptr == NULL) {
+        return 0;
+    }
+    if(in_slab_range(ptr)) {
+        return (*slab_of(ptr)).slot_size;
     }
+    return get_block_size(ptr);
+}
 ​
-    void *curr_free_block = last_free_block;
-    while(curr_free_block != NULL) {
+/* Function: compare_ptrs
+ * ___________________
+ * Description: qsort comparator ordering block pointers by address.
+ */
+int compare_ptrs(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)*(void * const *)a;
+    uintptr_t y = (uintptr_t)*(void * const *)b;
+    return (x > y) - (x < y);
+}
 ​
-        if(check_alloc(curr_free_block)) {
-            return false;
+/* Function: myfree_batch
+ * ___________________
+ * Parameters:
+ *    - ptrs: blocks to free (NULL entries are skipped). The array is sorted in place
+ *    - n: number of entries
+ *
+ * Return: N/A
+ *
+ * Description: This function sorts the blocks by address and walks them in order. Slab slots and MMAPPED blocks 
+ *              are released on their own. Arena blocks are gathered into runs of blocks that touch each other,
+ *              and each run is freed with heap_free_run, so neighbors inside the batch merge without ever being
+ *              put on a free list. Only the home arena is locked, once for the whole batch; blocks of other arenas
+ *              go onto their remote_frees stacks one by one, as arena_free would push them. Batched blocks skip 
+ *              the thread cache. With check_interval set, the arena blocks
+ *              count down the same sampled checks as myfree's, all run before any arena is locked.
+ */
+void myfree_batch(void **ptrs, size_t n) {
+    qsort(ptrs, n, sizeof(void *), compare_ptrs);
+    size_t first = 0;
+    while(first < n && ptrs[first] == NULL) {
+        first += 1;
+    }
+    count_many(&get_counts()->frees, n - first);
+    for(size_t i = first; i < n && __atomic_load_n(&profile_live, __ATOMIC_RELAXED) != 0; i++) {
+        profile_forget(ptrs[i]);
+    }
+    tcache *tc = get_tcache();
+    for(size_t i = first; i < n && check_interval != 0; i++) {
+        if(!in_slab_range(ptrs[i]) && !(__atomic_load_n(&(*get_hdr(ptrs[i])).block_size, __ATOMIC_RELAXED) & MMAPPED)
+           && --tc->check_countdown == 0) {
+            tc->check_countdown = next_check(tc);
+            check_freed(ptrs[i]);
         }
-        if(get_prev_free(curr_free_block) && get_next_free(get_prev_free(curr_free_block)) != curr_free_block) {
-            return false;
+    }
+    
+    arena *home = home_arena(tc);
+    bool locked = false;
+    for(size_t i = first; i < n; ) {
+        void *ptr = ptrs[i];
+        if(in_slab_range(ptr) || (__atomic_load_n(&(*get_hdr(ptr)).block_size, __ATOMIC_RELAXED) & MMAPPED)) {
+            in_slab_range(ptr) ? slab_free(ptr) : mmap_free(ptr);
+            i += 1;
+            continue;
         }
         
-        n_free -= 1;
-        curr_free_block = get_prev_free(curr_free_block);
+        arena *ar = arena_of(ptr);
+        if(ar != home) {
+            remote_push(ar, ptr);
+            i += 1;
+            continue;
+        }
+        if(!locked) {
+            lock_arena(home);
+            remote_drain(home);
+            locked = true;
+        }
+        size_t run = 1;
+        while(i + run < n && ptrs[i + run] == get_next_block(ptrs[i + run - 1])) {
+            run += 1;
+        }
+        heap_free_run(home, ptrs + i, run);
+        i += run;
     }
+    if(locked) {
+        unlock_arena(home);
+    }
+}
 ​
-    if(n_free != 0) {
-        return false;
+/* Function: resize_block
+ * ___________________
+ * Parameters:
+ *    - old_ptr: pointer to original block (not NULL)
+ *    - new_size: size of realloc request (not 0)
+ *
+ * Return: pointer to the reallocated block, NULL if it could not be grown (old_ptr is left untouched)
+ *
+ * Description: Slab slots are kept when the new size still rounds to the slot and moved otherwise (a shrink to 
+ *              a smaller class moves too, so the slot always matches the size myfree_sized is given). MMAPPED 
+ *              blocks that stay above mmap_threshold are resized with mremap, and ones that drop below it move into
+ *              the arenas.
+ *              Arena blocks that grow to mmap_threshold or beyond move into their own mapping right away, since from
+ *              then on mremap grows them without copying. Everything else tries heap_realloc, top_extend and 
+ *              left_extend, in that order, under the owning arena's lock. If the block can't be resized where it 
+ *              is, the lock is dropped and the block is moved with mymalloc (reserving grow_reserve's headroom when
+ *              it can, and copying only the curr_size bytes the block actually holds) and myfree. Growth that
+ *              doesn't go through mymalloc counts toward sampling through profile_grow.
+ */
+void *resize_block(void *old_ptr, size_t new_size) {
+    if(in_slab_range(old_ptr)) {
+        size_t slot_size = slab_of(old_ptr)->slot_size;
+        if(new_size <= slot_size && new_size > slot_size - block_align) {
+            return old_ptr;
+        }
+        void *new_ptr = mymalloc(new_size);
+        if(new_ptr != NULL) {
+            memcpy(new_ptr, old_ptr, (new_size < slot_size) ? new_size : slot_size);
+            myfree(old_ptr);
+        }
+        return new_ptr;
     }
-    return true;
+    size_t hdr_word = __atomic_load_n(&(*get_hdr(old_ptr)).block_size, __ATOMIC_RELAXED);
+    size_t size = round_up(new_size);
+    size_t curr_size = (hdr_word & ~FLAG_MASK) >> 2;
+    size_t grown = (size > curr_size) ? size - curr_size : 0;
+    if(hdr_word & MMAPPED) {
+        if(mmap_threshold != 0 && size >= mmap_threshold) {
+            void *new_ptr = mmap_realloc(old_ptr, size);
+            return (new_ptr != NULL) ? profile_grow(old_ptr, new_ptr, grown, new_size) : NULL;
+        }
+        void *new_ptr = mymalloc(new_size);
+        if(new_ptr != NULL) {
+            memcpy(new_ptr, old_ptr, new_size);
+            myfree(old_ptr);
+        }
+        return new_ptr;
+    }
+    
+    void *new_ptr = NULL;
+    if(mmap_threshold == 0 || size < mmap_threshold || size <= curr_size) {
+        arena *ar = arena_of(old_ptr);
+        lock_arena(ar);
+        new_ptr = heap_realloc(ar, old_ptr, new_size);
+        if(new_ptr == NULL) {
+            new_ptr = top_extend(ar, old_ptr, size);
+        }
+        if(new_ptr == NULL) {
+            new_ptr = left_extend(ar, old_ptr, size);
+        }
+        unlock_arena(ar);
+    }
+    if(new_ptr != NULL) {
+        return profile_grow(old_ptr, new_ptr, grown, new_size);
+    }
+    
+    size_t reserve = grow_reserve(size);
+    if((reserve > size && (new_ptr = mymalloc(reserve)) != NULL) || (new_ptr = mymalloc(new_size)) != NULL) {
+        memcpy(new_ptr, old_ptr, curr_size);
+        myfree(old_ptr);
+    }
+    return new_ptr;
 }
 ​
+/* Function: myrealloc
+ * ___________________
+ * Parameters:
+ *    - old_ptr: pointer to original block (subject of realloc request)
+ *    - new_size: size of realloc request
+ *
+ * Return: pointer to the reallocated block, NULL if it was freed or could not be grown
+ *
+ * Description: This function handles the NULL/0 cases through mymalloc and myfree and everything else through
+ *              resize_block, counting whether the block kept its address. A sampled block keeps its sample 
+ *              (see profile_moved). Growth counts toward sampling, through mymalloc when the block moves and
+ *              through profile_grow when it doesn't.
+ */
+void *myrealloc(void *old_ptr, size_t new_size) {
+    call_counts *cc = get_counts();
+    count(&cc->reallocs);
+    if(old_ptr == NULL) {
+        return mymalloc(new_size);
+    }
+    if(new_size == 0) {
+        myfree(old_ptr);
+        return NULL;
+    }
+    if(new_size > MAX_REQUEST) {
+        return NULL;
+    }
     
+    void *new_ptr = resize_block(old_ptr, new_size);
+    if(new_ptr != NULL) {
+        count((new_ptr == old_ptr) ? &cc->reallocs_in_place : &cc->reallocs_moved);
+        if(__atomic_load_n(&profile_live, __ATOMIC_RELAXED) != 0) {
+            profile_moved(old_ptr, new_ptr, new_size);
+        }
+    }
+    return new_ptr;
+}
+​
+/* Function: validate_heap
+ * ___________________
+ * Return: true if every arena is consistent, false otherwise
+ *
+ * Description: This function runs validate_arena on each arena under that arena's lock.
+ */
+bool validate_heap() {
+    for(size_t i = 0; i < narenas; i++) {
+        lock_arena(&arenas[i]);
+        bool valid = validate_arena(&arenas[i]);
+        unlock_arena(&arenas[i]);
+        if(!valid) {
+            return false;
+        }
+    }
+    return true;
+}
+​
+/* Function: validate_heap_step
+ * ___________________
+ * Parameters:
+ *    - max_blocks: number of blocks to check in this call
+ *
+ * Return: true if every block checked was intact, false otherwise
+ *
+ * Description: This function is the incremental counterpart to validate_heap for heaps too big to stop for a full
+ *              walk. It runs check_block on the next max_blocks blocks after the cursor, moving on through the 
+ *              arena's chunks and then to the next arena (wrapping around after the last), and saves its place 
+ *              for the next call. Only the arena being walked is locked, and only for the current call. If the 
+ *              arena merged any blocks since the cursor was saved, the cursor's block may now sit inside a bigger
+ *              one, so the walk starts over at the beginning of the cursor's chunk. A failed check also leaves the
+ *              cursor at the start of that chunk. Calls from different threads are serialized by cursor_lock.
+ */
+bool validate_heap_step(size_t max_blocks) {
+    pthread_mutex_lock(&cursor_lock);
+    if(cursor.generation != heap_generation) {
+        cursor.generation = heap_generation;
+        cursor.arena = 0;
+        cursor.ch = &arenas[0].base;
+        cursor.block = NULL;
+    }
+    bool valid = true;
+    size_t checked = 0;
+    while(valid && checked < max_blocks) {
+        arena *ar = &arenas[cursor.arena];
+        lock_arena(ar);
+        if(cursor.block == NULL || cursor.merges != ar->merges) {
+            cursor.block = (*cursor.ch).start_block;
+            cursor.merges = ar->merges;
+        }
+        while(checked < max_blocks && cursor.block < (*cursor.ch).segment_end) {
+            if(!check_block(ar, cursor.ch, cursor.block)) {
+                valid = false;
+                cursor.block = NULL;
+                break;
+            }
+            cursor.block = get_next_block(cursor.block);
+            checked += 1;
+        }
+        if(valid && cursor.block == (*cursor.ch).segment_end) {
+            cursor.block = NULL;
+            if((*cursor.ch).next != NULL) {
+                cursor.ch = (*cursor.ch).next;
+            } else {
+                cursor.arena = (cursor.arena + 1) % narenas;
+                cursor.ch = &arenas[cursor.arena].base;
+            }
+        }
+        unlock_arena(ar);
+    }
+    pthread_mutex_unlock(&cursor_lock);
+    return valid;
+}
+​
+/* Function: myfork_prepare
+ * ___________________
+ * Return: N/A
+ *
+ * Description: Register this (with myfork_parent and myfork_child) through pthread_atfork in programs that fork
+ *              while other threads may be inside the allocator. It takes every lock the allocator has, outermost 
+ *              first: cursor_lock and counts_lock (validate_heap_step and get_counts can reach an arena lock while
+ *              holding them), profile_lock, then the arena locks in index order and finally region_lock, which 
+ *              grow_arena takes under an arena's lock. With all of them held, no other thread is halfway through 
+ *              changing the heap when fork copies it.
+ */
+void myfork_prepare(void) {
+    pthread_mutex_lock(&cursor_lock);
+    pthread_mutex_lock(&counts_lock);
+    pthread_mutex_lock(&profile_lock);
+    for(size_t i = 0; i < narenas; i++) {
+        lock_arena(&arenas[i]);
+    }
+    pthread_mutex_lock(&region_lock);
+}
+​
+/* Function: myfork_parent
+ * ___________________
+ * Return: N/A
+ *
+ * Description: This function releases the locks myfork_prepare took, in the reverse order.
+ */
+void myfork_parent(void) {
+    pthread_mutex_unlock(&region_lock);
+    for(size_t i = narenas; i > 0; i--) {
+        unlock_arena(&arenas[i - 1]);
+    }
+    pthread_mutex_unlock(&profile_lock);
+    pthread_mutex_unlock(&counts_lock);
+    pthread_mutex_unlock(&cursor_lock);
+}
+​
+/* Function: myfork_child
+ * ___________________
+ * Return: N/A
+ *
+ * Description: The child's only thread is the one that called fork and took the locks, so they are released 
+ *              just like in the parent and the heap is consistent. Blocks cached by the parent's other threads 
+ *              stay allocated in the child, since no thread is left to drain them.
+ */
+void myfork_child(void) {
+    myfork_parent();
+}
@@ -0,0 +1,212 @@
+/* Luke Tchang
+ * CS 107
+ * explicit_allocator.h: Extensions to the allocator.h interface that only the explicit allocator provides. 
+ *                       Clients that only need myinit/mymalloc/myfree/myrealloc can ignore this file.
+ */
+#ifndef EXPLICIT_ALLOCATOR_H
+#define EXPLICIT_ALLOCATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//CONSTANTS:
+//__________
+#define ARENA_ROUND_ROBIN 0
+#define ARENA_BY_CPU 1
+#define FIT_FIRST 0
+#define FIT_BEST 1
+#define FIT_ADDRESS 2
+#define STATS_BUCKETS 32
+#define STATS_NODES 8
+#define LAYOUT_MAGIC "HLAY"
+#define LAYOUT_VERSION 1
+#define LAYOUT_ALLOC 0x1
+#define LAYOUT_LISTED 0x2
+#define LAYOUT_TREE 0x4
+#define LAYOUT_WILDERNESS 0x8
+#define LAYOUT_TRIMMED 0x10
+
+/* Struct: myregion
+ * ________________
+ * Description: Opaque handle for a bump-pointer region made by myregion_create. Everything allocated from a 
+ *              region is released together by myregion_reset or myregion_destroy.
+ */
+typedef struct myregion myregion;
+
+/* Struct: mypool
+ * ______________
+ * Description: Opaque handle for a pool of fixed-size objects made by mypool_create. Objects come from aligned 
+ *              chunks taken from the heap and go back to the pool with mypool_free.
+ */
+typedef struct mypool mypool;
+
+/* Struct: allocator_config
+ * ________________________
+ * Description: Options for myinit_config. A zeroed struct (or a NULL config) sets up the same heap as myinit.
+ *    - narenas: number of independent arenas to split the segment into (0 and 1 both mean one arena, max 64)
+ *    - arena_select: ARENA_ROUND_ROBIN gives each new thread the next arena in turn, ARENA_BY_CPU picks the
+ *                    arena from the CPU the thread is running on
+ *    - grow_size: when non-zero, an arena that runs out of memory maps a chunk of at least this many bytes
+ *                 (doubling each time) instead of failing the request
+ *    - mmap_threshold: when non-zero, requests of at least this many bytes get their own mmap'd mapping, which 
+ *                      myfree unmaps and myrealloc resizes with mremap
+ *    - slab_region_size: when non-zero, this much address space is reserved for page-sized slabs that serve
+ *                        requests of up to 64 bytes with no per-object header and no locking
+ *    - fit_policy: FIT_FIRST searches the segregated free lists (first fit within a class), FIT_BEST keeps free
+ *                  blocks of 128 bytes and up in a size-keyed splay tree and always picks the smallest block 
+ *                  that fits, FIT_ADDRESS keeps the lists of blocks of 128 bytes and up sorted by address so 
+ *                  first fit takes the lowest block that fits and live blocks stay packed toward the bottom
+ *    - compact_links: store free list links as 32-bit offsets instead of pointers, so the minimum block
+ *                     (header included) is 16 bytes instead of 24. The segment and everything grow_size maps
+ *                     must then fit within 32 GiB of heap_start (growth that lands further away fails)
+ *    - default_alignment: alignment of every block, 8 (the default, also used for 0) or 16 for full-width
+ *                         SIMD loads on any allocation
+ *    - defer_coalesce: blocks of up to 1 KB freed back to an arena wait on exact-size quick lists and are reused
+ *                      as they are, with a merge pass only once an allocation finds nothing else or too many pile up
+ *    - segment_zeroed: the segment is known to be zero-filled (e.g. fresh from mmap), so mycalloc doesn't clear 
+ *                      the parts of it that haven't been handed out yet
+ *    - huge_pages: back the heap with 2 MB pages. The segment, the slab region and MMAPPED blocks of 2 MB and up 
+ *                  are marked MADV_HUGEPAGE, growth maps whole huge pages (MAP_HUGETLB when the system has some
+ *                  reserved, 2 MB-aligned transparent huge pages otherwise), and mytrim only releases whole huge
+ *                  pages so it never splits one
+ *    - numa_arenas: spread the arenas over the machine's NUMA nodes (arena i on node i % nodes, memory bound 
+ *                   with mbind as the preferred node) and have each thread allocate from an arena on the node 
+ *                   it is running on, which overrides arena_select. narenas should be at least the node count
+ *    - check_interval: when non-zero, about one in this many frees first checks the freed block's header and 
+ *                      footer, its neighbors and their free list links, and aborts with a message on stderr if 
+ *                      any of them is corrupt (validate_heap_step is the matching incremental walk)
+ */
+typedef struct {
+    size_t narenas;
+    int arena_select;
+    size_t grow_size;
+    size_t mmap_threshold;
+    size_t slab_region_size;
+    int fit_policy;
+    bool compact_links;
+    size_t default_alignment;
+    bool defer_coalesce;
+    bool segment_zeroed;
+    bool huge_pages;
+    bool numa_arenas;
+    size_t check_interval;
+} allocator_config;
+
+/* Struct: allocator_stats
+ * _______________________
+ * Description: Snapshot returned by mystats. Sizes are payload bytes (block headers are not counted).
+ *    - bytes_used / bytes_free: allocated and free bytes in the arenas (blocks held in per-thread caches count
+ *                               as used)
+ *    - free_histogram: free bytes by block size, bucket i holding blocks of 2^i up to 2^(i+1) - 1 bytes
+ *                      (the last bucket also takes everything bigger)
+ *    - largest_free: size of the largest free block in any arena
+ *    - nblocks: number of blocks (free and allocated) in the arenas
+ *    - bytes_mmapped / bytes_slabs: memory held by MMAPPED blocks and by slabs handed out so far
+ *    - bytes_decommitted: bytes inside free blocks that are known to be zero-filled: given back to the kernel 
+ *                         by mytrim, or never touched since they were mapped
+ *    - mallocs / frees / reallocs: calls since myinit (mallocs and frees include the ones a moving realloc makes)
+ *    - reallocs_in_place / reallocs_moved: reallocs that kept or changed the block's address
+ *    - coalesces / splits: neighbor merges on free and free blocks split to serve a request
+ *    - avg_probe_length: average number of free blocks a fit search looked at
+ *    - numa_nodes: number of nodes the arenas are spread over (1 without numa_arenas)
+ *    - node_bytes_used / node_bytes_free: bytes_used and bytes_free split by the node of the arena holding them
+ *                                         (nodes past STATS_NODES share the entries modulo STATS_NODES)
+ */
+typedef struct {
+    size_t bytes_used;
+    size_t bytes_free;
+    size_t free_histogram[STATS_BUCKETS];
+    size_t largest_free;
+    size_t nblocks;
+    size_t bytes_mmapped;
+    size_t bytes_slabs;
+    size_t bytes_decommitted;
+    size_t mallocs;
+    size_t frees;
+    size_t reallocs;
+    size_t reallocs_in_place;
+    size_t reallocs_moved;
+    size_t coalesces;
+    size_t splits;
+    double avg_probe_length;
+    size_t numa_nodes;
+    size_t node_bytes_used[STATS_NODES];
+    size_t node_bytes_free[STATS_NODES];
+} allocator_stats;
+
+/* Struct: layout_header
+ * _____________________
+ * Description: First record of a mydump_layout stream. Every record is in host byte order.
+ *    - magic / version: LAYOUT_MAGIC (not NUL-terminated) and LAYOUT_VERSION
+ *    - payload_align: alignment of every payload in the heap that was dumped
+ *    - narenas: number of arenas (chunk records name their arena by index)
+ *    - heap_base / heap_end: address range of the segment passed to myinit
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t payload_align;
+    uint32_t narenas;
+    uint64_t heap_base;
+    uint64_t heap_end;
+} layout_header;
+
+/* Struct: layout_chunk
+ * ____________________
+ * Description: Starts the records of one arena chunk (the arena's slice of the segment, or a range it grew into).
+ *              layout_block records follow until the blocks reach end.
+ *    - arena: index of the chunk's arena
+ *    - start / end: address of the chunk's first payload, and the end of its last block
+ */
+typedef struct {
+    uint32_t arena;
+    uint32_t pad;
+    uint64_t start;
+    uint64_t end;
+} layout_chunk;
+
+/* Struct: layout_block
+ * ____________________
+ * Description: One block of a chunk, in address order. The block spans its 8-byte header plus size bytes, so the 
+ *              next block's payload starts at offset + size + 8.
+ *    - offset: distance of the payload from the chunk's start
+ *    - info: payload size << 16 | size class << 8 | LAYOUT_* flags (LAYOUT_ALLOC for allocated blocks; 
+ *            LAYOUT_LISTED, LAYOUT_TREE or LAYOUT_WILDERNESS for where a free block is kept, with 
+ *            LAYOUT_TRIMMED added when its pages are known to be zero)
+ */
+typedef struct {
+    uint64_t offset;
+    uint64_t info;
+} layout_block;
+
+bool myinit_config(void *heap_start, size_t heap_size, const allocator_config *config);
+allocator_stats mystats(void);
+size_t mytrim(void);
+void *myaligned_alloc(size_t alignment, size_t size);
+int myposix_memalign(void **memptr, size_t alignment, size_t size);
+void *mycalloc(size_t nmemb, size_t size);
+void *mymalloc_onnode(size_t size, int node);
+size_t mymalloc_batch(size_t size, size_t count, void **out);
+void myfree_batch(void **ptrs, size_t n);
+void myfree_sized(void *ptr, size_t size);
+size_t myusable_size(void *ptr);
+bool validate_heap_step(size_t max_blocks);
+bool myprofile_start(size_t sample_bytes);
+void myprofile_stop(void);
+bool myprofile_dump(int fd);
+bool mydump_layout(int fd);
+myregion *myregion_create(size_t size);
+void *myregion_alloc(myregion *r, size_t size);
+void myregion_reset(myregion *r);
+void myregion_destroy(myregion *r);
+mypool *mypool_create(size_t obj_size, size_t align);
+void mypool_release_empty(mypool *pool, bool release);
+void *mypool_alloc(mypool *pool);
+void mypool_free(mypool *pool, void *ptr);
+void mypool_destroy(mypool *pool);
+void myfork_prepare(void);
+void myfork_parent(void);
+void myfork_child(void);
+
+#endif
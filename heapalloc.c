@@ -0,0 +1,292 @@
+/* Luke Tchang
+ * CS 107
+ * heapalloc: This file turns the explicit allocator into a drop-in replacement for the C library's allocator. 
+ *            Built together with explicit_allocator.c (and heapalloc_new.cpp for C++ programs) as 
+ *            libheapalloc.so, it can be loaded into an unmodified binary with LD_PRELOAD (see README.md). The 
+ *            first call maps its own segment and runs myinit_config, so nothing has to call myinit. Everything 
+ *            is compiled with hidden visibility except the functions below, which keeps the allocator's internal
+ *            helpers from clashing with the program's own symbols.
+ */
+#include "allocator.h"
+#include "explicit_allocator.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+​
+​
+//CONSTANTS:
+//__________
+#define SHIM_EXPORT __attribute__((visibility("default")))
+#define SHIM_HEAP_SIZE (64UL << 20)
+#define SHIM_GROW_SIZE (64UL << 20)
+#define SHIM_MMAP_THRESHOLD (256UL << 10)
+#define SHIM_SLAB_REGION (1UL << 30)
+#define SHIM_MAX_ARENAS 8
+#define HEAP_UNINIT 0
+#define HEAP_STARTING 1
+#define HEAP_READY 2
+#define HEAP_FAILED 3
+​
+/* GLOBAL VARIABLES:
+ * _________________
+ * heap_state: HEAP_UNINIT until the first call, HEAP_STARTING while that call sets the heap up, then HEAP_READY 
+ *             (or HEAP_FAILED if the segment couldn't be mapped)
+ */
+static int heap_state;
+​
+​
+//HELPERS:
+//________
+​
+/* Function: ensure_heap
+ * ___________________
+ * Return: true once the heap is set up, false if it never could be
+ *
+ * Description: The first thread to get here reserves SHIM_HEAP_SIZE bytes of address space and passes it to 
+ *              myinit_config with 16-byte alignment (what the C library guarantees), one arena per CPU up to 
+ *              SHIM_MAX_ARENAS spread over the NUMA nodes, growth, the mmap path and slabs all turned on. The 
+ *              mapping is fresh, so it is passed as segment_zeroed for calloc. Threads that race it spin until it
+ *              is done. Nothing here allocates, so the C library can't call back in while the heap is half built.
+ *              Once the heap is ready the myfork handlers are registered with pthread_atfork (which may allocate),
+ *              so a child forked while other threads are in the allocator doesn't inherit its locks held.
+ */
+bool ensure_heap(void) {
+    int state = __atomic_load_n(&heap_state, __ATOMIC_ACQUIRE);
+    if(state == HEAP_READY) {
+        return true;
+    }
+    if(state == HEAP_UNINIT && __atomic_compare_exchange_n(&heap_state, &state, HEAP_STARTING, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+        allocator_config config = {0};
+        config.narenas = (ncpus < 1) ? 1 : (ncpus > SHIM_MAX_ARENAS) ? SHIM_MAX_ARENAS : ncpus;
+        config.grow_size = SHIM_GROW_SIZE;
+        config.mmap_threshold = SHIM_MMAP_THRESHOLD;
+        config.slab_region_size = SHIM_SLAB_REGION;
+        config.default_alignment = 16;
+        config.segment_zeroed = true;
+        config.numa_arenas = true;
+        
+        void *map = mmap(NULL, SHIM_HEAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        bool ready = map != MAP_FAILED && myinit_config(map, SHIM_HEAP_SIZE, &config);
+        __atomic_store_n(&heap_state, ready ? HEAP_READY : HEAP_FAILED, __ATOMIC_RELEASE);
+        if(ready) {
+            pthread_atfork(myfork_prepare, myfork_parent, myfork_child);
+        }
+        return ready;
+    }
+    while((state = __atomic_load_n(&heap_state, __ATOMIC_ACQUIRE)) == HEAP_STARTING) {
+        sched_yield();
+    }
+    return state == HEAP_READY;
+}
+​
+/* Function: shim_malloc
+ * ___________________
+ * Parameters:
+ *    - size: requested size (0 is treated as 1 so every call gets a distinct pointer)
+ *
+ * Return: pointer to the new block, NULL (with errno set to ENOMEM) if there is no memory
+ */
+void *shim_malloc(size_t size) {
+    void *block = ensure_heap() ? mymalloc((size != 0) ? size : 1) : NULL;
+    if(block == NULL) {
+        errno = ENOMEM;
+    }
+    return block;
+}
+​
+/* Function: shim_aligned
+ * ___________________
+ * Parameters:
+ *    - alignment: required alignment (a power of two)
+ *    - size: requested size (0 is treated as 1)
+ *
+ * Return: pointer to the new block, NULL (with errno set to EINVAL or ENOMEM) on failure
+ */
+void *shim_aligned(size_t alignment, size_t size) {
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    void *block = ensure_heap() ? myaligned_alloc(alignment, (size != 0) ? size : 1) : NULL;
+    if(block == NULL) {
+        errno = ENOMEM;
+    }
+    return block;
+}
+​
+/* Function: shim_free
+ * ___________________
+ * Parameters:
+ *    - ptr: block to free (NULL, or anything freed before the heap exists, is ignored)
+ *    - size: size the block was allocated with, or 0 if the caller doesn't know it
+ *
+ * Return: N/A
+ *
+ * Description: A known size takes the myfree_sized path (C++ sized delete), everything else goes through myfree.
+ */
+void shim_free(void *ptr, size_t size) {
+    if(ptr == NULL || __atomic_load_n(&heap_state, __ATOMIC_ACQUIRE) != HEAP_READY) {
+        return;
+    }
+    if(size != 0) {
+        myfree_sized(ptr, size);
+    } else {
+        myfree(ptr);
+    }
+}
+​
+​
+//C LIBRARY INTERFACE:
+//____________________
+​
+/* Function: malloc
+ * ___________________
+ * Parameters:
+ *    - size: requested size
+ *
+ * Return: pointer to a block of at least size bytes aligned to 16, NULL if out of memory
+ */
+SHIM_EXPORT void *malloc(size_t size) {
+    return shim_malloc(size);
+}
+​
+/* Function: free
+ * ___________________
+ * Parameters:
+ *    - ptr: block to free
+ *
+ * Return: N/A
+ */
+SHIM_EXPORT void free(void *ptr) {
+    shim_free(ptr, 0);
+}
+​
+/* Function: calloc
+ * ___________________
+ * Parameters:
+ *    - nmemb: number of elements
+ *    - size: size of each element
+ *
+ * Return: pointer to nmemb * size zeroed bytes, NULL if the product overflows or there is no memory
+ *
+ * Description: A zero-byte request gets a distinct one-byte block, like malloc(0). Clearing is left to mycalloc, 
+ *              which skips memory it knows is still zero.
+ */
+SHIM_EXPORT void *calloc(size_t nmemb, size_t size) {
+    if(nmemb == 0 || size == 0) {
+        nmemb = size = 1;
+    }
+    void *block = ensure_heap() ? mycalloc(nmemb, size) : NULL;
+    if(block == NULL) {
+        errno = ENOMEM;
+    }
+    return block;
+}
+​
+/* Function: realloc
+ * ___________________
+ * Parameters:
+ *    - ptr: block to resize (NULL behaves like malloc)
+ *    - size: new size (0 frees ptr and returns NULL, as glibc does)
+ *
+ * Return: pointer to the resized block, NULL if ptr was freed or couldn't be resized (ptr is then left alone)
+ */
+SHIM_EXPORT void *realloc(void *ptr, size_t size) {
+    if(ptr == NULL) {
+        return shim_malloc(size);
+    }
+    void *block = myrealloc(ptr, size);
+    if(block == NULL && size != 0) {
+        errno = ENOMEM;
+    }
+    return block;
+}
+​
+/* Function: reallocarray
+ * ___________________
+ * Parameters:
+ *    - ptr: block to resize
+ *    - nmemb / size: new size as an element count and element size
+ *
+ * Return: like realloc, but NULL with errno set to ENOMEM if nmemb * size overflows
+ */
+SHIM_EXPORT void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+    if(size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return realloc(ptr, nmemb * size);
+}
+​
+/* Function: aligned_alloc
+ * ___________________
+ * Parameters:
+ *    - alignment: required alignment (a power of two)
+ *    - size: requested size
+ *
+ * Return: pointer to a block at a multiple of alignment, NULL on failure
+ */
+SHIM_EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+    return shim_aligned(alignment, size);
+}
+​
+/* Function: memalign
+ * ___________________
+ * Description: Obsolete spelling of aligned_alloc.
+ */
+SHIM_EXPORT void *memalign(size_t alignment, size_t size) {
+    return shim_aligned(alignment, size);
+}
+​
+/* Function: posix_memalign
+ * ___________________
+ * Parameters:
+ *    - memptr: where to store the new block
+ *    - alignment: required alignment (a power of two and a multiple of sizeof(void *))
+ *    - size: requested size
+ *
+ * Return: 0 on success, EINVAL for a bad alignment, ENOMEM if out of memory (errno is left alone)
+ */
+SHIM_EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if(!ensure_heap()) {
+        return ENOMEM;
+    }
+    return myposix_memalign(memptr, alignment, size);
+}
+​
+/* Function: valloc
+ * ___________________
+ * Description: Obsolete: a page-aligned block.
+ */
+SHIM_EXPORT void *valloc(size_t size) {
+    return shim_aligned(sysconf(_SC_PAGESIZE), size);
+}
+​
+/* Function: pvalloc
+ * ___________________
+ * Description: Obsolete: a page-aligned block whose size is rounded up to a whole number of pages.
+ */
+SHIM_EXPORT void *pvalloc(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    if(size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return shim_aligned(page, (size + page - 1) & ~(page - 1));
+}
+​
+/* Function: malloc_usable_size
+ * ___________________
+ * Parameters:
+ *    - ptr: block returned by one of the functions above (or NULL)
+ *
+ * Return: number of bytes usable at ptr (see myusable_size)
+ */
+SHIM_EXPORT size_t malloc_usable_size(void *ptr) {
+    return myusable_size(ptr);
+}
@@ -0,0 +1,142 @@
+/* Luke Tchang
+ * CS 107
+ * heapalloc_new: The C++ allocation operators for libheapalloc.so. Every form of operator new and delete 
+ *                (array, nothrow, sized and C++17 aligned) is routed to the same heap as malloc through the
+ *                shim functions in heapalloc.c. Throwing forms follow the standard: call the new_handler until it
+ *                frees memory, and throw std::bad_alloc when there is none.
+ */
+#include <cstddef>
+#include <new>
+​
+#define SHIM_EXPORT __attribute__((visibility("default")))
+​
+extern "C" {
+void *shim_malloc(size_t size);
+void *shim_aligned(size_t alignment, size_t size);
+void shim_free(void *ptr, size_t size);
+}
+​
+/* Function: new_block
+ * ___________________
+ * Parameters:
+ *    - size: requested size
+ *    - alignment: required alignment, 0 for the default
+ *    - nothrow: return NULL instead of throwing when there is no memory
+ *
+ * Return: pointer to the new block
+ *
+ * Description: This function retries the allocation after each call to the installed new_handler, as
+ *              operator new must, and gives up (throwing std::bad_alloc or returning NULL) once there is none.
+ */
+static void *new_block(size_t size, size_t alignment, bool nothrow) {
+    while(true) {
+        void *block = (alignment != 0) ? shim_aligned(alignment, size) : shim_malloc(size);
+        if(block != NULL) {
+            return block;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if(handler == NULL) {
+            if(nothrow) {
+                return NULL;
+            }
+            throw std::bad_alloc();
+        }
+        if(nothrow) {
+            try {
+                handler();
+            } catch(...) {
+                return NULL;
+            }
+        } else {
+            handler();
+        }
+    }
+}
+​
+​
+//OPERATOR NEW:
+//_____________
+SHIM_EXPORT void *operator new(size_t size) {
+    return new_block(size, 0, false);
+}
+​
+SHIM_EXPORT void *operator new[](size_t size) {
+    return new_block(size, 0, false);
+}
+​
+SHIM_EXPORT void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return new_block(size, 0, true);
+}
+​
+SHIM_EXPORT void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return new_block(size, 0, true);
+}
+​
+SHIM_EXPORT void *operator new(size_t size, std::align_val_t alignment) {
+    return new_block(size, static_cast<size_t>(alignment), false);
+}
+​
+SHIM_EXPORT void *operator new[](size_t size, std::align_val_t alignment) {
+    return new_block(size, static_cast<size_t>(alignment), false);
+}
+​
+SHIM_EXPORT void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return new_block(size, static_cast<size_t>(alignment), true);
+}
+​
+SHIM_EXPORT void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+    return new_block(size, static_cast<size_t>(alignment), true);
+}
+​
+​
+//OPERATOR DELETE:
+//________________
+//Sized deletes of default-aligned blocks pass the size on so the block can go to the thread cache without its
+//header being read. Aligned blocks always take the plain path, since their size says nothing about the padding.
+SHIM_EXPORT void operator delete(void *ptr) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete[](void *ptr) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete(void *ptr, size_t size) noexcept {
+    shim_free(ptr, size);
+}
+​
+SHIM_EXPORT void operator delete[](void *ptr, size_t size) noexcept {
+    shim_free(ptr, size);
+}
+​
+SHIM_EXPORT void operator delete(void *ptr, std::align_val_t) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete[](void *ptr, std::align_val_t) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+    shim_free(ptr, 0);
+}
+​
+SHIM_EXPORT void operator delete[](void *ptr, size_t, std::align_val_t) noexcept {
+    shim_free(ptr, 0);
+}
@@ -0,0 +1,495 @@
+/* Luke Tchang
+ * CS 107
+ * heapmap: This program reads heap snapshots written by mydump_layout (see explicit_allocator.h) and reports how 
+ *          fragmented they are, so fit policies and other allocator changes can be judged on layouts captured 
+ *          from real programs. For every arena and for the whole heap it prints block counts, used and free 
+ *          bytes, the largest free block and two fragmentation scores: external fragmentation (the share of free 
+ *          bytes outside the largest free block, 0 when all free space is in one piece) and the unusable free 
+ *          share (free bytes in blocks too small to serve a request of -u bytes). It then draws every chunk as a
+ *          heatmap, one character per cell of -c bytes, from '.' (all free) to '#' (all in use), with ' ' for 
+ *          cells whose free pages were trimmed. -p also writes the heatmap as a PPM image, one pixel per cell.
+ */
+#include "explicit_allocator.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+​
+​
+//CONSTANTS:
+//__________
+#define HEADER_BYTES 8
+#define DEFAULT_WIDTH 64
+#define DEFAULT_ROWS 16
+#define DEFAULT_UNUSABLE 4096
+#define SIZE_BUCKETS 40
+#define MAX_ARENAS 64
+​
+/* GLOBAL VARIABLES:
+ * _________________
+ * shades: heatmap characters from an all-free cell to an all-used one
+ */
+static const char shades[] = ".:-=+*%#";
+​
+​
+//STRUCT INFO
+//___________
+​
+/* Struct: frag_totals
+ * ___________________
+ * Description: The "frag_totals" struct adds up the blocks of one arena (or of the whole heap).
+ *    - chunks / blocks / free_blocks: numbers of chunks, blocks and free blocks
+ *    - used_bytes / free_bytes: payload bytes of allocated and of free blocks (headers count in neither)
+ *    - trimmed_bytes: free bytes in blocks flagged LAYOUT_TRIMMED
+ *    - largest_free: size of the largest free block
+ *    - unusable_bytes: free bytes in blocks smaller than the -u size
+ *    - free_by_size: free bytes by block size, bucket i holding blocks of 2^i up to 2^(i+1) - 1 bytes
+ */
+typedef struct {
+    uint64_t chunks;
+    uint64_t blocks;
+    uint64_t free_blocks;
+    uint64_t used_bytes;
+    uint64_t free_bytes;
+    uint64_t trimmed_bytes;
+    uint64_t largest_free;
+    uint64_t unusable_bytes;
+    uint64_t free_by_size[SIZE_BUCKETS];
+} frag_totals;
+​
+/* Struct: heatmap
+ * _______________
+ * Description: The "heatmap" struct holds the cells of the chunk being read and, when a PPM image was asked for,
+ *              the pixels of every chunk so far (rows of width pixels, three bytes each).
+ *    - used / free / trimmed: bytes of each kind in every cell of the current chunk (headers count as used)
+ *    - ncells / cell_bytes: number of cells in the current chunk and how many bytes each one covers
+ *    - pixels / nrows / capacity: image rows written so far and room allocated for them
+ */
+typedef struct {
+    uint64_t *used;
+    uint64_t *free;
+    uint64_t *trimmed;
+    size_t ncells;
+    uint64_t cell_bytes;
+    size_t width;
+    unsigned char *pixels;
+    size_t nrows;
+    size_t capacity;
+} heatmap;
+​
+​
+//SCORING:
+//________
+​
+/* Function: size_bucket
+ * ___________________
+ * Parameters:
+ *    - size: free block size
+ *
+ * Return: index of the free_by_size bucket for the size (floor of its log2, capped at the last bucket)
+ */
+int size_bucket(uint64_t size) {
+    int log2 = (size != 0) ? 63 - __builtin_clzll(size) : 0;
+    return (log2 < SIZE_BUCKETS) ? log2 : SIZE_BUCKETS - 1;
+}
+​
+/* Function: add_block
+ * ___________________
+ * Parameters:
+ *    - totals: totals to add the block to
+ *    - info: the block's layout_block info word
+ *    - unusable: request size below which a free block counts as unusable
+ *
+ * Return: N/A
+ */
+void add_block(frag_totals *totals, uint64_t info, uint64_t unusable) {
+    uint64_t size = info >> 16;
+    totals->blocks += 1;
+    if(info & LAYOUT_ALLOC) {
+        totals->used_bytes += size;
+        return;
+    }
+    totals->free_blocks += 1;
+    totals->free_bytes += size;
+    totals->free_by_size[size_bucket(size)] += size;
+    if(info & LAYOUT_TRIMMED) {
+        totals->trimmed_bytes += size;
+    }
+    if(size > totals->largest_free) {
+        totals->largest_free = size;
+    }
+    if(size < unusable) {
+        totals->unusable_bytes += size;
+    }
+}
+​
+/* Function: merge_totals
+ * ___________________
+ * Parameters:
+ *    - into: totals to add to
+ *    - from: totals to add
+ *
+ * Return: N/A
+ */
+void merge_totals(frag_totals *into, const frag_totals *from) {
+    into->chunks += from->chunks;
+    into->blocks += from->blocks;
+    into->free_blocks += from->free_blocks;
+    into->used_bytes += from->used_bytes;
+    into->free_bytes += from->free_bytes;
+    into->trimmed_bytes += from->trimmed_bytes;
+    into->unusable_bytes += from->unusable_bytes;
+    if(from->largest_free > into->largest_free) {
+        into->largest_free = from->largest_free;
+    }
+    for(int i = 0; i < SIZE_BUCKETS; i++) {
+        into->free_by_size[i] += from->free_by_size[i];
+    }
+}
+​
+/* Function: print_totals
+ * ___________________
+ * Parameters:
+ *    - label: row label
+ *    - totals: totals to print
+ *
+ * Return: N/A
+ *
+ * Description: Prints one summary row. External fragmentation is 1 - largest_free / free_bytes and the unusable
+ *              share is unusable_bytes / free_bytes (both 0 when nothing is free).
+ */
+void print_totals(const char *label, const frag_totals *totals) {
+    double free_bytes = (double)totals->free_bytes;
+    double ext_frag = (totals->free_bytes != 0) ? 1 - totals->largest_free / free_bytes : 0;
+    double unusable = (totals->free_bytes != 0) ? totals->unusable_bytes / free_bytes : 0;
+    double util = (totals->used_bytes + totals->free_bytes != 0) ? totals->used_bytes / (double)(totals->used_bytes + totals->free_bytes) : 0;
+    printf("%-8s %7llu %10llu %10llu %14llu %14llu %14llu %8.1f%% %8.1f%% %8.1f%%\n", label,
+           (unsigned long long)totals->chunks, (unsigned long long)totals->blocks, (unsigned long long)totals->free_blocks,
+           (unsigned long long)totals->used_bytes, (unsigned long long)totals->free_bytes, (unsigned long long)totals->largest_free,
+           util * 100, ext_frag * 100, unusable * 100);
+}
+​
+/* Function: print_histogram
+ * ___________________
+ * Parameters:
+ *    - totals: totals of the whole heap
+ *
+ * Return: N/A
+ *
+ * Description: Prints the free bytes held by blocks of each power-of-two size range, skipping empty ranges.
+ */
+void print_histogram(const frag_totals *totals) {
+    printf("\nfree bytes by block size:\n");
+    for(int i = 0; i < SIZE_BUCKETS; i++) {
+        if(totals->free_by_size[i] != 0) {
+            double share = (double)totals->free_by_size[i] / (double)totals->free_bytes;
+            printf("  %12llu+ %14llu %6.1f%%\n", 1ULL << i, (unsigned long long)totals->free_by_size[i], share * 100);
+        }
+    }
+}
+​
+​
+//HEATMAP:
+//________
+​
+/* Function: start_chunk
+ * ___________________
+ * Parameters:
+ *    - map: heatmap
+ *    - len: length of the chunk in bytes
+ *    - cell_bytes: bytes per cell (0 picks one that draws the chunk in about DEFAULT_ROWS rows)
+ *
+ * Return: true if the cells could be allocated, false otherwise
+ */
+bool start_chunk(heatmap *map, uint64_t len, uint64_t cell_bytes) {
+    if(cell_bytes == 0) {
+        cell_bytes = (len + map->width * DEFAULT_ROWS - 1) / (map->width * DEFAULT_ROWS);
+        cell_bytes = (cell_bytes + HEADER_BYTES - 1) & ~(uint64_t)(HEADER_BYTES - 1);
+        cell_bytes = (cell_bytes != 0) ? cell_bytes : HEADER_BYTES;
+    }
+    map->cell_bytes = cell_bytes;
+    map->ncells = (len + cell_bytes - 1) / cell_bytes;
+    free(map->used);
+    free(map->free);
+    free(map->trimmed);
+    map->used = calloc(map->ncells + 1, sizeof(uint64_t));
+    map->free = calloc(map->ncells + 1, sizeof(uint64_t));
+    map->trimmed = calloc(map->ncells + 1, sizeof(uint64_t));
+    return map->used != NULL && map->free != NULL && map->trimmed != NULL;
+}
+​
+/* Function: paint_range
+ * ___________________
+ * Parameters:
+ *    - cells: per-cell byte counts to add to
+ *    - cell_bytes: bytes per cell
+ *    - start / end: byte range within the chunk
+ *
+ * Return: N/A
+ */
+void paint_range(uint64_t *cells, uint64_t cell_bytes, uint64_t start, uint64_t end) {
+    while(start < end) {
+        uint64_t cell = start / cell_bytes;
+        uint64_t cell_end = (cell + 1) * cell_bytes;
+        uint64_t stop = (end < cell_end) ? end : cell_end;
+        cells[cell] += stop - start;
+        start = stop;
+    }
+}
+​
+/* Function: paint_block
+ * ___________________
+ * Parameters:
+ *    - map: heatmap of the current chunk
+ *    - rec: block record
+ *
+ * Return: N/A
+ *
+ * Description: The block's header counts as used. The header of a chunk's first block sits just before the 
+ *              chunk's start and isn't drawn.
+ */
+void paint_block(heatmap *map, const layout_block *rec) {
+    uint64_t size = rec->info >> 16;
+    uint64_t start = (rec->offset >= HEADER_BYTES) ? rec->offset - HEADER_BYTES : 0;
+    paint_range(map->used, map->cell_bytes, start, rec->offset);
+    uint64_t *cells = (rec->info & LAYOUT_ALLOC) ? map->used : (rec->info & LAYOUT_TRIMMED) ? map->trimmed : map->free;
+    paint_range(cells, map->cell_bytes, rec->offset, rec->offset + size);
+}
+​
+/* Function: add_pixel_row
+ * ___________________
+ * Parameters:
+ *    - map: heatmap
+ *
+ * Return: pointer to a new image row (black), NULL if it couldn't be allocated
+ */
+unsigned char *add_pixel_row(heatmap *map) {
+    if(map->nrows == map->capacity) {
+        size_t capacity = (map->capacity != 0) ? map->capacity * 2 : 64;
+        unsigned char *pixels = realloc(map->pixels, capacity * map->width * 3);
+        if(pixels == NULL) {
+            return NULL;
+        }
+        map->pixels = pixels;
+        map->capacity = capacity;
+    }
+    unsigned char *row = map->pixels + map->nrows * map->width * 3;
+    memset(row, 0, map->width * 3);
+    map->nrows += 1;
+    return row;
+}
+​
+/* Function: draw_chunk
+ * ___________________
+ * Parameters:
+ *    - map: heatmap of the chunk just read
+ *    - image: also add the chunk's rows to the PPM image
+ *
+ * Return: true unless an image row couldn't be allocated
+ *
+ * Description: Prints the chunk's cells width to a line. A cell's shade is its used share, and a cell holding
+ *              only trimmed free bytes is blank. Image pixels go from red (free) to green (used), trimmed cells
+ *              are dark blue, and a grey row separates chunks.
+ */
+bool draw_chunk(heatmap *map, bool image) {
+    unsigned char *row = NULL;
+    for(size_t cell = 0; cell < map->ncells; cell++) {
+        uint64_t total = map->used[cell] + map->free[cell] + map->trimmed[cell];
+        double used = (total != 0) ? (double)map->used[cell] / total : 1;
+        bool trimmed = map->trimmed[cell] != 0 && map->used[cell] == 0 && map->free[cell] == 0;
+        putchar(trimmed ? ' ' : shades[(int)(used * (sizeof(shades) - 2) + 0.5)]);
+        if(image && cell % map->width == 0 && (row = add_pixel_row(map)) == NULL) {
+            return false;
+        }
+        if(image) {
+            unsigned char *pixel = row + (cell % map->width) * 3;
+            pixel[0] = trimmed ? 0 : (unsigned char)(255 * (1 - used));
+            pixel[1] = trimmed ? 0 : (unsigned char)(255 * used);
+            pixel[2] = trimmed ? 128 : 0;
+        }
+        if(cell % map->width == map->width - 1 || cell == map->ncells - 1) {
+            putchar('\n');
+        }
+    }
+    if(image) {
+        if((row = add_pixel_row(map)) == NULL) {
+            return false;
+        }
+        memset(row, 96, map->width * 3);
+    }
+    return true;
+}
+​
+/* Function: write_ppm
+ * ___________________
+ * Parameters:
+ *    - path: image file to create
+ *    - map: heatmap holding every chunk's rows
+ *
+ * Return: true if the whole image was written, false otherwise
+ */
+bool write_ppm(const char *path, const heatmap *map) {
+    FILE *fp = fopen(path, "wb");
+    if(fp == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    bool ok = fprintf(fp, "P6\n%zu %zu\n255\n", map->width, map->nrows) > 0;
+    ok = ok && (map->nrows == 0 || fwrite(map->pixels, map->width * 3, map->nrows, fp) == map->nrows);
+    return (fclose(fp) == 0) && ok;
+}
+​
+​
+//READING:
+//________
+​
+/* Function: read_dump
+ * ___________________
+ * Parameters:
+ *    - fp: open snapshot
+ *    - map: heatmap (its width is already set)
+ *    - cell_bytes: -c value (0 to size cells per chunk)
+ *    - unusable: -u value
+ *    - image: keep image rows for -p
+ *    - arena_totals: filled in per arena (MAX_ARENAS entries)
+ *    - narenas: set to the header's arena count
+ *
+ * Return: true if the snapshot was read to the end without errors, false otherwise
+ *
+ * Description: Reads the layout_header and then chunk after chunk, each chunk's layout_block records until the
+ *              blocks reach its end, drawing each chunk as soon as it is complete.
+ */
+bool read_dump(FILE *fp, heatmap *map, uint64_t cell_bytes, uint64_t unusable, bool image, frag_totals *arena_totals, uint32_t *narenas) {
+    layout_header header;
+    if(fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, LAYOUT_MAGIC, sizeof(header.magic)) != 0 || header.version != LAYOUT_VERSION) {
+        fprintf(stderr, "not a heap layout snapshot\n");
+        return false;
+    }
+    *narenas = (header.narenas < MAX_ARENAS) ? header.narenas : MAX_ARENAS;
+    printf("heap 0x%llx-0x%llx, %u arenas, %u-byte alignment\n\n", (unsigned long long)header.heap_base,
+           (unsigned long long)header.heap_end, header.narenas, header.payload_align);
+
+    layout_chunk ch;
+    while(fread(&ch, sizeof(ch), 1, fp) == 1) {
+        if(ch.arena >= *narenas || ch.end < ch.start) {
+            fprintf(stderr, "bad chunk record\n");
+            return false;
+        }
+        uint64_t len = ch.end - ch.start;
+        if(!start_chunk(map, len, cell_bytes)) {
+            perror("calloc");
+            return false;
+        }
+        frag_totals *totals = &arena_totals[ch.arena];
+        totals->chunks += 1;
+        printf("arena %u chunk 0x%llx, %llu bytes, %llu bytes per cell\n", ch.arena, (unsigned long long)ch.start,
+               (unsigned long long)len, (unsigned long long)map->cell_bytes);
+        uint64_t pos = 0;
+        while(pos < len) {
+            layout_block rec;
+            if(fread(&rec, sizeof(rec), 1, fp) != 1) {
+                fprintf(stderr, "snapshot ends inside a chunk\n");
+                return false;
+            }
+            uint64_t size = rec.info >> 16;
+            if(rec.offset != pos || size > len - rec.offset) {
+                fprintf(stderr, "block at offset %llu doesn't follow the one before it\n", (unsigned long long)rec.offset);
+                return false;
+            }
+            add_block(totals, rec.info, unusable);
+            paint_block(map, &rec);
+            pos = rec.offset + size + HEADER_BYTES;
+        }
+        if(!draw_chunk(map, image)) {
+            perror("realloc");
+            return false;
+        }
+        putchar('\n');
+    }
+    return !ferror(fp);
+}
+​
+​
+//MAIN:
+//_____
+​
+/* Function: usage
+ * ___________________
+ * Description: Prints the command line options to stderr.
+ */
+void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-w width] [-c cell_bytes] [-u bytes] [-p out.ppm] snapshot\n"
+                    "  snapshot: file written by mydump_layout, or - for stdin\n"
+                    "  -w: heatmap cells per line (default 64)\n"
+                    "  -c: bytes per cell (default: about 16 lines per chunk)\n"
+                    "  -u: request size for the unusable free share (default 4096)\n"
+                    "  -p: also write the heatmap as a PPM image\n", prog);
+}
+​
+int main(int argc, char *argv[]) {
+    heatmap map = {0};
+    map.width = DEFAULT_WIDTH;
+    uint64_t cell_bytes = 0;
+    uint64_t unusable = DEFAULT_UNUSABLE;
+    const char *ppm_path = NULL;
+    int first = 1;
+
+    for(; first < argc && argv[first][0] == '-' && argv[first][1] != '\0'; first++) {
+        char flag = argv[first][1];
+        if(first + 1 >= argc || (flag != 'w' && flag != 'c' && flag != 'u' && flag != 'p')) {
+            usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++first];
+        if(flag == 'w') {
+            map.width = strtoull(value, NULL, 0);
+        } else if(flag == 'c') {
+            cell_bytes = strtoull(value, NULL, 0);
+        } else if(flag == 'u') {
+            unusable = strtoull(value, NULL, 0);
+        } else {
+            ppm_path = value;
+        }
+    }
+    if(argc - first != 1 || map.width == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE *fp = (strcmp(argv[first], "-") == 0) ? stdin : fopen(argv[first], "rb");
+    if(fp == NULL) {
+        fprintf(stderr, "%s: %s\n", argv[first], strerror(errno));
+        return 1;
+    }
+    frag_totals arena_totals[MAX_ARENAS] = {{0}};
+    uint32_t narenas = 0;
+    bool ok = read_dump(fp, &map, cell_bytes, unusable, ppm_path != NULL, arena_totals, &narenas);
+    if(fp != stdin) {
+        fclose(fp);
+    }
+
+    frag_totals heap_totals = {0};
+    printf("%-8s %7s %10s %10s %14s %14s %14s %9s %9s %9s\n", "arena", "chunks", "blocks", "free blks", "used bytes",
+           "free bytes", "largest free", "util", "ext frag", "unusable");
+    for(uint32_t i = 0; i < narenas; i++) {
+        char label[16];
+        snprintf(label, sizeof(label), "%u", i);
+        print_totals(label, &arena_totals[i]);
+        merge_totals(&heap_totals, &arena_totals[i]);
+    }
+    print_totals("total", &heap_totals);
+    printf("trimmed free bytes: %llu\n", (unsigned long long)heap_totals.trimmed_bytes);
+    if(heap_totals.free_bytes != 0) {
+        print_histogram(&heap_totals);
+    }
+    if(ok && ppm_path != NULL) {
+        ok = write_ppm(ppm_path, &map);
+    }
+    free(map.used);
+    free(map.free);
+    free(map.trimmed);
+    free(map.pixels);
+    return ok ? 0 : 1;
+}
@@ -2,7 +2,8 @@
  * CS 107
  * implicit: This program is an implementation of an implicit free list heap allocator. The only major design decision 
  *           was using first_fit search for malloc requests. Other than that, free is standard (doesn't support coalesce)
- *           and realloc doesn't support in place operations.
+ *           and realloc resizes in place when the block shrinks or the free blocks right after it have room, moving the
+ *           block (and copying only the bytes it holds) otherwise.
  */ 
 #include "allocator.h"
 #include "debug_break.h"
@@ -287,6 +288,19 @@ void myfree(void *ptr) {
     }
 }
 ​
+/* Function: myrealloc
+ * ___________________
+ * Parameters:
+ *    - old_ptr: pointer to block being resized (NULL acts like mymalloc)
+ *    - new_size: requested size (0 acts like myfree)
+ *
+ * Return: pointer to the resized block, NULL if there is no room (old_ptr is left untouched)
+ *
+ * Description: This function absorbs the free blocks directly to the right of the block until it is big enough
+ *              (a shrink needs none), then splits any leftover back off as a free block, the same way mymalloc does.
+ *              Only if the free space to the right runs out is the block moved, copying the smaller of its old 
+ *              size and the new size.
+ */
 void *myrealloc(void *old_ptr, size_t new_size) {
     if(old_ptr == NULL) {
         return mymalloc(new_size);
@@ -295,9 +309,37 @@ void *myrealloc(void *old_ptr, size_t new_size) {
         myfree(old_ptr);
         return NULL;
     }
+    
+    size_t curr_size = get_block_size(old_ptr);
+    size_t req_size = round_up(new_size);
+    size_t total_size = curr_size;
+    int absorbed = 0;
+    void *next_block = get_next_block(old_ptr);
+    while(total_size < req_size && next_block != NULL && !check_alloc(next_block)) {
+        total_size += get_block_size(next_block) + WIDTH;
+        absorbed += 1;
+        next_block = get_next_block(next_block);
+    }
+    
+    if(total_size >= req_size) {
+        size_t size_diff = total_size - req_size;
+        set_hdr_size(old_ptr, req_size);
+        nblocks -= absorbed;
+        if(size_diff > 0) {
+            void *free_block = get_next_block(old_ptr);
+            set_hdr_size(free_block, size_diff - WIDTH);
+            set_hdr_status(free_block, FREE);
+            nblocks += 1;
+        }
+        bytes_used = bytes_used - curr_size + req_size;
+        return old_ptr;
+    }
+    
     void *new_ptr = mymalloc(new_size);
-    memcpy(new_ptr, old_ptr, new_size);
-    myfree(old_ptr);
+    if(new_ptr != NULL) {
+        memcpy(new_ptr, old_ptr, (curr_size < new_size) ? curr_size : new_size);
+        myfree(old_ptr);
+    }
     return new_ptr;
 }
 ​